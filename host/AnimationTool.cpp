@@ -0,0 +1,168 @@
+// Build an animation for the flash partition of the device, see
+// main/Animation.h.
+//
+// Usage: make-animation [--rgb] [--repeat N] [--frames N] [--capture CAPTURE]
+//                       IMAGE [recording]
+//
+// Frames come from a recording (see host/Recording.h) or, without one, are
+// synthesized. By default they are pre-encoded through the default output
+// stage, --rgb stores colors instead, which take a quarter of the space and go
+// through the output stage of the device. Each frame is shown for --repeat
+// device frames. IMAGE can be used directly as the partition of the emulator
+// (--flash). With --capture, a capture uploading the animation and playing it
+// once is written as well, paced as on a 115200 baud link.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Animation.h"
+#include "Capture.h"
+#include "FrameEncoder.h"
+#include "Recording.h"
+
+using Coordinates = LEDArray<MaxLEDs, MaxPorts>::TheCoordinateSystem;
+constexpr size_t Columns = Coordinates::columns();
+constexpr size_t Lines = Coordinates::lines();
+
+static std::vector<FrameEncoder::Frame> synthesize(size_t Count) {
+  std::vector<FrameEncoder::Frame> Result;
+  for (size_t Time = 0; Time < Count; ++Time) {
+    FrameEncoder::Frame Frame(Columns * Lines);
+    for (size_t Line = 0; Line < Lines; ++Line)
+      for (size_t Column = 0; Column < Columns; ++Column)
+        Frame[Line * Columns + Column].Color =
+            HSVColor((Column + Line + Time * 8) * 4, 255, 64);
+    Result.push_back(std::move(Frame));
+  }
+  return Result;
+}
+
+static std::vector<uint8_t>
+makeImage(const std::vector<FrameEncoder::Frame> &Frames,
+          ExternalFormat Format, uint16_t Repeat) {
+  Animation::Header Header;
+  Header.Format = Format;
+  Header.Ports = MaxPorts;
+  Header.LEDsPerStrip = MaxLEDs;
+  Header.Frames = Frames.size();
+  Header.FrameRepeat = Repeat;
+
+  std::vector<uint8_t> Image(sizeof(Header));
+  memcpy(Image.data(), &Header, sizeof(Header));
+
+  OutputStage Stage;
+  std::vector<RGBColor> Physical(MaxPorts * MaxLEDs);
+  for (const FrameEncoder::Frame &Frame : Frames) {
+    for (size_t Line = 0; Line < Lines; ++Line) {
+      for (size_t Column = 0; Column < Columns; ++Column) {
+        LEDCoordinate Coordinate =
+            Coordinates::convert(Point{Column, Line});
+        Physical[Coordinate.StripIndex * MaxLEDs + Coordinate.LEDIndex] =
+            Frame[Line * Columns + Column].Color.toRGBColor();
+      }
+    }
+
+    for (const RGBColor &Color : Physical) {
+      if (Format == ExternalFormat::RGB) {
+        const auto *Bytes = reinterpret_cast<const uint8_t *>(&Color);
+        Image.insert(Image.end(), Bytes, Bytes + sizeof(Color));
+      } else {
+        WS2812::EncodedLED Encoded = WS2812::encode(Stage.apply(Color));
+        const auto *Bytes = reinterpret_cast<const uint8_t *>(&Encoded);
+        Image.insert(Image.end(), Bytes, Bytes + sizeof(Encoded));
+      }
+    }
+  }
+
+  return Image;
+}
+
+static bool writeCapture(const char *Path, const std::vector<uint8_t> &Image) {
+  FILE *File = fopen(Path, "wb");
+  if (File == nullptr)
+    return false;
+
+  FrameEncoder Encoder(Columns, Lines);
+  FrameEncoder::Stream Stream;
+  Encoder.helo(Stream);
+  Encoder.uploadAnimation(Image, Stream);
+  Encoder.playAnimation(Command::PlayAnimationMessage::Once, Stream);
+
+  // 10 bits per byte on the wire
+  constexpr size_t BytesPerSecond = 115200 / 10;
+  constexpr size_t ChunkSize = 4096;
+  Capture::Writer Writer(File);
+  for (size_t Offset = 0; Offset < Stream.size(); Offset += ChunkSize) {
+    size_t Size = std::min(ChunkSize, Stream.size() - Offset);
+    Writer.write(uint64_t(Offset) * 1000000 / BytesPerSecond, &Stream[Offset],
+                 Size);
+  }
+
+  fclose(File);
+  return true;
+}
+
+int main(int Argc, char **Argv) {
+  ExternalFormat Format = ExternalFormat::Encoded;
+  unsigned long Repeat = 1;
+  size_t SynthesizedFrames = 32;
+  const char *CapturePath = nullptr;
+  const char *ImagePath = nullptr;
+  const char *RecordingPath = nullptr;
+  for (int I = 1; I < Argc; ++I) {
+    if (strcmp(Argv[I], "--rgb") == 0)
+      Format = ExternalFormat::RGB;
+    else if (strcmp(Argv[I], "--repeat") == 0 and I + 1 < Argc)
+      Repeat = strtoul(Argv[++I], nullptr, 10);
+    else if (strcmp(Argv[I], "--frames") == 0 and I + 1 < Argc)
+      SynthesizedFrames = strtoul(Argv[++I], nullptr, 10);
+    else if (strcmp(Argv[I], "--capture") == 0 and I + 1 < Argc)
+      CapturePath = Argv[++I];
+    else if (ImagePath == nullptr)
+      ImagePath = Argv[I];
+    else
+      RecordingPath = Argv[I];
+  }
+
+  if (ImagePath == nullptr or Repeat == 0 or Repeat > UINT16_MAX) {
+    fprintf(stderr,
+            "Usage: %s [--rgb] [--repeat N] [--frames N] [--capture CAPTURE] "
+            "IMAGE [recording]\n",
+            Argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<FrameEncoder::Frame> Frames;
+  if (RecordingPath == nullptr) {
+    Frames = synthesize(SynthesizedFrames);
+  } else if (not Recording::load(RecordingPath, Columns, Lines, Frames)) {
+    perror(RecordingPath);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<uint8_t> Image = makeImage(Frames, Format, Repeat);
+  Animation::Header Header;
+  memcpy(&Header, Image.data(), sizeof(Header));
+  if (not Header.verify(Animation::HostPartitionSize)) {
+    fprintf(stderr, "%zu frames do not fit in the partition (%zu bytes)\n",
+            Frames.size(), Animation::HostPartitionSize);
+    return EXIT_FAILURE;
+  }
+
+  FILE *File = fopen(ImagePath, "wb");
+  if (File == nullptr or fwrite(Image.data(), 1, Image.size(), File) !=
+                             Image.size()) {
+    perror(ImagePath);
+    return EXIT_FAILURE;
+  }
+  fclose(File);
+
+  if (CapturePath != nullptr and not writeCapture(CapturePath, Image)) {
+    perror(CapturePath);
+    return EXIT_FAILURE;
+  }
+
+  printf("%zu frames, %zu bytes\n", Frames.size(), Image.size());
+  return EXIT_SUCCESS;
+}
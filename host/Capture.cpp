@@ -0,0 +1,42 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "Capture.h"
+
+namespace Capture {
+
+Writer::Writer(FILE *File) : File(File) {
+  FileHeader Header;
+  fwrite(&Header, sizeof(Header), 1, File);
+}
+
+void Writer::write(uint64_t TimestampMicros, const uint8_t *Data,
+                   size_t Size) {
+  ChunkHeader Header;
+  Header.TimestampMicros = TimestampMicros;
+  Header.Length = Size;
+  fwrite(&Header, sizeof(Header), 1, File);
+  fwrite(Data, 1, Size, File);
+}
+
+Reader::Reader(FILE *File) : File(File) {
+  FileHeader Expected;
+  FileHeader Header;
+  if (fread(&Header, sizeof(Header), 1, File) != 1 or
+      Header.Magic != Expected.Magic or Header.Version != Expected.Version) {
+    fprintf(stderr, "Not a capture, or unsupported version\n");
+    abort();
+  }
+}
+
+bool Reader::next(Chunk &Result) {
+  ChunkHeader Header;
+  if (fread(&Header, sizeof(Header), 1, File) != 1)
+    return false;
+
+  Result.TimestampMicros = Header.TimestampMicros;
+  Result.Data.resize(Header.Length);
+  return fread(Result.Data.data(), 1, Header.Length, File) == Header.Length;
+}
+
+} // namespace Capture
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+/// Recordings of the byte stream received by a device.
+///
+/// A capture starts with a FileHeader, followed by any number of chunks. Each
+/// chunk is a ChunkHeader followed by Length bytes of stream. Timestamps are
+/// relative to the beginning of the capture. All the fields are little endian.
+namespace Capture {
+
+struct FileHeader {
+  std::array<char, 4> Magic = {'L', 'C', 'A', 'P'};
+  uint32_t Version = 1;
+};
+
+struct ChunkHeader {
+  uint64_t TimestampMicros = 0;
+  uint32_t Length = 0;
+  uint32_t Reserved = 0;
+};
+
+static_assert(sizeof(FileHeader) == 8);
+static_assert(sizeof(ChunkHeader) == 16);
+
+struct Chunk {
+  uint64_t TimestampMicros = 0;
+  std::vector<uint8_t> Data;
+};
+
+class Writer {
+private:
+  FILE *File;
+
+public:
+  /// Start a capture on File, which stays owned by the caller
+  explicit Writer(FILE *File);
+
+  void write(uint64_t TimestampMicros, const uint8_t *Data, size_t Size);
+};
+
+class Reader {
+private:
+  FILE *File;
+
+public:
+  /// Open a capture from File, which stays owned by the caller. Aborts if
+  /// File is not a capture.
+  explicit Reader(FILE *File);
+
+  /// Read the next chunk, false at the end of the capture
+  bool next(Chunk &Result);
+};
+
+} // namespace Capture
@@ -0,0 +1,48 @@
+// Record the stream going to a device: copy the standard input to the
+// standard output, saving each chunk as it arrives, with its timestamp, to a
+// capture file.
+//
+// Usage: producer | capture OUTPUT > /dev/ttyUSB0
+
+#include <chrono>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Capture.h"
+
+int main(int Argc, char **Argv) {
+  if (Argc != 2) {
+    fprintf(stderr, "Usage: %s OUTPUT\n", Argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  FILE *File = fopen(Argv[1], "wb");
+  if (File == nullptr) {
+    perror(Argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  Capture::Writer Writer(File);
+
+  using namespace std::chrono;
+  auto Start = steady_clock::now();
+  uint8_t Buffer[4096];
+  while (true) {
+    ssize_t Size = read(STDIN_FILENO, Buffer, sizeof(Buffer));
+    if (Size <= 0)
+      break;
+
+    auto Timestamp = duration_cast<microseconds>(steady_clock::now() - Start);
+    Writer.write(Timestamp.count(), Buffer, Size);
+
+    for (ssize_t Written = 0; Written < Size;) {
+      ssize_t Result = write(STDOUT_FILENO, Buffer + Written, Size - Written);
+      if (Result <= 0)
+        return EXIT_FAILURE;
+      Written += Result;
+    }
+  }
+
+  fclose(File);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+// Throughput and robustness of the frame decoder.
+//
+// Usage: decode-benchmark [frames [corrupted-percentage]]
+//
+// Random frames are encoded with Framing::encode, a fraction of them is then
+// corrupted (flipped bits, truncation) or preceded by garbage, and the whole
+// stream is fed to Framing::Decoder in chunks of random size, as reads from the
+// serial port would. Every intact frame must come out unchanged, and nothing
+// else must come out.
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "Framing.h"
+
+using Payload = std::vector<uint8_t>;
+
+int main(int argc, char *argv[]) {
+  size_t Count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+  unsigned CorruptedPercentage = argc > 2 ? strtoul(argv[2], nullptr, 10) : 10;
+
+  std::mt19937 Random(42);
+  auto uniform = [&](size_t Limit) { return Random() % Limit; };
+
+  std::vector<Payload> Expected;
+  std::vector<uint8_t> Stream;
+  size_t Corrupted = 0;
+  size_t Noisy = 0;
+  for (size_t I = 0; I < Count; ++I) {
+    // Mostly small frames, with plenty of zeroes as in the real stream
+    Payload Frame(1 + uniform(uniform(8) == 0 ? Framing::MaxPayload : 64));
+    for (uint8_t &Byte : Frame)
+      Byte = uniform(4) == 0 ? 0 : uniform(256);
+
+    size_t Start = Stream.size();
+    Framing::encode(Frame.data(), Frame.size(), Stream);
+
+    if (uniform(100) >= CorruptedPercentage) {
+      Expected.push_back(std::move(Frame));
+      continue;
+    }
+
+    size_t Size = Stream.size() - Start - 1;
+    switch (uniform(3)) {
+    case 0: {
+      // Flip a bit, making sure not to introduce a delimiter
+      uint8_t &Byte = Stream[Start + uniform(Size)];
+      uint8_t Flipped = Byte ^ (1 << uniform(8));
+      Byte = Flipped == Framing::Delimiter ? Byte ^ 0xFF : Flipped;
+      ++Corrupted;
+      break;
+    }
+
+    case 1:
+      // Truncate, as if the beginning of the frame was lost
+      Stream.erase(Stream.begin() + Start,
+                   Stream.begin() + Start + 1 + uniform(Size));
+      ++Corrupted;
+      break;
+
+    case 2: {
+      // Line noise, possibly longer than the receive buffer, followed by a
+      // delimiter: the frame after it must get through
+      std::vector<uint8_t> Noise(1 + uniform(Framing::MaxEncodedSize * 2));
+      for (uint8_t &Byte : Noise)
+        Byte = 1 + uniform(255);
+      Noise.push_back(Framing::Delimiter);
+      Stream.insert(Stream.begin() + Start, Noise.begin(), Noise.end());
+      Expected.push_back(std::move(Frame));
+      ++Noisy;
+      break;
+    }
+    }
+  }
+
+  Framing::Decoder Decoder;
+  size_t Received = 0;
+  size_t Mismatches = 0;
+  size_t ChunkSize = 0;
+  auto Start = std::chrono::steady_clock::now();
+  for (size_t Offset = 0; Offset < Stream.size(); Offset += ChunkSize) {
+    ArrayRef<uint8_t> Space = Decoder.space();
+    ChunkSize = std::min<size_t>(
+        {1 + uniform(256), Space.Size, Stream.size() - Offset});
+    memcpy(Space.Data, &Stream[Offset], ChunkSize);
+    Decoder.commit(ChunkSize, [&](ArrayRef<const uint8_t> Frame) {
+      // A corrupted frame can pass the CRC check with probability 2^-32
+      if (Received < Expected.size() and
+          Frame.Size == Expected[Received].size() and
+          memcmp(Frame.Data, Expected[Received].data(), Frame.Size) == 0) {
+        ++Received;
+      } else {
+        ++Mismatches;
+      }
+    });
+  }
+  std::chrono::duration<double> Elapsed =
+      std::chrono::steady_clock::now() - Start;
+
+  printf("%zu frames (%zu corrupted, %zu after noise), %zu bytes\n", Count,
+         Corrupted, Noisy, Stream.size());
+  printf("%.2f MB/s, %.1f ns/byte\n", Stream.size() / Elapsed.count() / 1e6,
+         Elapsed.count() * 1e9 / Stream.size());
+  printf("received %zu/%zu intact frames, %zu unexpected\n", Received,
+         Expected.size(), Mismatches);
+  printf("framing errors %u, CRC errors %u, overflows %u\n",
+         Statistics.FramingErrors, Statistics.CRCErrors, Statistics.Overflows);
+
+  return Received == Expected.size() and Mismatches == 0 ? EXIT_SUCCESS
+                                                         : EXIT_FAILURE;
+}
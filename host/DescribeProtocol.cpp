@@ -0,0 +1,11 @@
+// Print the JSON description of the commands supported by the firmware, as
+// generated from its command registry.
+//
+// Usage: describe-protocol > protocol.json
+
+#include "Command.h"
+
+int main() {
+  Command::describe(stdout);
+  return 0;
+}
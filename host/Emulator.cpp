@@ -0,0 +1,185 @@
+// Headless emulator of the device: replay a capture through the firmware's
+// command parser and renderer, with the strips replaced by a sink decoding
+// what would go on the wire.
+//
+// Usage: emulator [--realtime] [--checksums FILE] [--ppm DIRECTORY]
+//                 [--flash FILE] CAPTURE
+//
+// A frame is rendered after each read from the capture, and then until the
+// last transition or animation is over (looping animations are cut short).
+// --flash backs the animation partition with FILE, which persists across
+// runs, instead of memory. Without --realtime the capture
+// is replayed as fast as possible. --checksums writes a checksum of the
+// physical strips for each frame, --ppm an image of them (one line per strip)
+// for each frame that differs from the previous one. The replies of the device
+// go to the standard output, the throughput report to the standard error.
+
+#include <chrono>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "Capture.h"
+#include "Command.h"
+
+static std::array<std::array<RGBColor, MaxLEDs>, MaxPorts> Physical;
+
+static void sink(size_t Gpio, ArrayRef<const uint8_t> Buffer) {
+  assert(Gpio < MaxPorts);
+  const auto *LEDs = reinterpret_cast<const WS2812::EncodedLED *>(Buffer.Data);
+  size_t Count = Buffer.Size / sizeof(WS2812::EncodedLED);
+  for (size_t I = 0; I < Count; ++I)
+    Physical[Gpio][I] = WS2812::decode(LEDs[I]);
+}
+
+static uint64_t checksum() {
+  // FNV-1a
+  uint64_t Result = 0xcbf29ce484222325;
+  const auto *Bytes = reinterpret_cast<const uint8_t *>(&Physical);
+  for (size_t I = 0; I < sizeof(Physical); ++I)
+    Result = (Result ^ Bytes[I]) * 0x100000001b3;
+  return Result;
+}
+
+static void writeImage(const std::string &Directory, size_t Frame) {
+  char Name[32];
+  snprintf(Name, sizeof(Name), "/frame-%06zu.ppm", Frame);
+  std::string Path = Directory + Name;
+  FILE *File = fopen(Path.c_str(), "wb");
+  if (File == nullptr) {
+    perror(Path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  fprintf(File, "P6\n%zu %zu\n255\n", MaxLEDs, MaxPorts);
+  fwrite(&Physical, sizeof(Physical), 1, File);
+  fclose(File);
+}
+
+static void feed(Capture::Reader &Reader, int Output, bool RealTime,
+                 size_t &Bytes) {
+  using namespace std::chrono;
+  auto Start = steady_clock::now();
+  Capture::Chunk Chunk;
+  while (Reader.next(Chunk)) {
+    if (RealTime)
+      std::this_thread::sleep_until(Start +
+                                    microseconds(Chunk.TimestampMicros));
+
+    for (size_t Written = 0; Written < Chunk.Data.size();) {
+      ssize_t Result = write(Output, Chunk.Data.data() + Written,
+                             Chunk.Data.size() - Written);
+      if (Result <= 0)
+        break;
+      Written += Result;
+    }
+    Bytes += Chunk.Data.size();
+  }
+  close(Output);
+}
+
+int main(int Argc, char **Argv) {
+  bool RealTime = false;
+  const char *ChecksumsPath = nullptr;
+  const char *ImagesDirectory = nullptr;
+  const char *CapturePath = nullptr;
+  for (int I = 1; I < Argc; ++I) {
+    if (strcmp(Argv[I], "--realtime") == 0)
+      RealTime = true;
+    else if (strcmp(Argv[I], "--checksums") == 0 and I + 1 < Argc)
+      ChecksumsPath = Argv[++I];
+    else if (strcmp(Argv[I], "--ppm") == 0 and I + 1 < Argc)
+      ImagesDirectory = Argv[++I];
+    else if (strcmp(Argv[I], "--flash") == 0 and I + 1 < Argc)
+      Animation::HostPartitionFile = Argv[++I];
+    else
+      CapturePath = Argv[I];
+  }
+
+  if (CapturePath == nullptr) {
+    fprintf(stderr,
+            "Usage: %s [--realtime] [--checksums FILE] [--ppm DIRECTORY] "
+            "[--flash FILE] CAPTURE\n",
+            Argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  FILE *CaptureFile = fopen(CapturePath, "rb");
+  if (CaptureFile == nullptr) {
+    perror(CapturePath);
+    return EXIT_FAILURE;
+  }
+  Capture::Reader Reader(CaptureFile);
+
+  FILE *Checksums = nullptr;
+  if (ChecksumsPath != nullptr and
+      (Checksums = fopen(ChecksumsPath, "w")) == nullptr) {
+    perror(ChecksumsPath);
+    return EXIT_FAILURE;
+  }
+
+  // The capture reaches the parser through a pipe, as it would through the
+  // serial port
+  int Pipe[2];
+  if (pipe(Pipe) != 0) {
+    perror("pipe");
+    return EXIT_FAILURE;
+  }
+  Command::setInput(Pipe[0]);
+  HostPinSink = &sink;
+
+  using namespace std::chrono;
+  start_time = ledian_clock::now();
+  auto Start = steady_clock::now();
+
+  size_t Bytes = 0;
+  std::thread Feeder(feed, std::ref(Reader), Pipe[1], RealTime,
+                     std::ref(Bytes));
+
+  size_t Frame = 0;
+  uint64_t LastChecksum = 0;
+  auto renderFrame = [&]() {
+    LEDs.render(Frame);
+    Command::frameDone();
+
+    uint64_t Checksum = checksum();
+    if (Checksums != nullptr)
+      fprintf(Checksums, "%zu %016llx\n", Frame, (unsigned long long)Checksum);
+    if (ImagesDirectory != nullptr and (Frame == 0 or Checksum != LastChecksum))
+      writeImage(ImagesDirectory, Frame);
+    LastChecksum = Checksum;
+    ++Frame;
+  };
+
+  while (Command::parse())
+    if (Command::frameReady())
+      renderFrame();
+
+  // Let the last transition or animation play out
+  constexpr size_t MaxTrailingFrames = 1000;
+  for (size_t I = 0; I < MaxTrailingFrames and
+                     (LEDs.tweening() or Command::animating());
+       ++I)
+    renderFrame();
+
+  Feeder.join();
+  double Elapsed = duration<double>(steady_clock::now() - Start).count();
+
+  size_t Commands = 0;
+  for (uint32_t Count : Statistics.Commands)
+    Commands += Count;
+
+  fprintf(stderr, "%zu bytes, %zu commands, %zu frames in %.3f s\n", Bytes,
+          Commands, Frame, Elapsed);
+  fprintf(stderr, "%.2f MB/s, %.0f commands/s, %.0f frames/s\n",
+          Bytes / Elapsed / 1e6, Commands / Elapsed, Frame / Elapsed);
+  fprintf(stderr, "render %u/%.1f/%u us (min/avg/max)\n",
+          Statistics.Render.MinMicros,
+          double(Statistics.Render.TotalMicros) / Statistics.Render.Count,
+          Statistics.Render.MaxMicros);
+
+  if (Checksums != nullptr)
+    fclose(Checksums);
+  fclose(CaptureFile);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+// Check that rendering only the LEDs that changed, as render does, yields the
+// same strips as encoding all of them again at every frame.
+//
+// Usage: encode-check [frames]
+//
+// Two arrays go through the same random sequence of writes, blink toggles,
+// overlay writes and settings, transitions, output stage changes and power
+// budgets. One renders incrementally, with several render threads, the other
+// one has all its LEDs marked dirty before each frame. After each frame, the
+// buffers sent to the strips must be identical. Both 8-bit and 16-bit LEDs are
+// checked.
+
+#include <functional>
+#include <memory>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "LED.h"
+
+template <bool Deep> using CheckArray = LEDArray<MaxLEDs, MaxPorts, Deep>;
+
+/// Returns the number of strips, over all the frames, that did not match
+template <bool Deep> static size_t check(size_t Frames) {
+  auto Incremental = std::make_unique<CheckArray<Deep>>();
+  auto Full = std::make_unique<CheckArray<Deep>>();
+  Incremental->setRenderThreads(3);
+
+  using Coordinates = typename CheckArray<Deep>::TheCoordinateSystem;
+  std::mt19937 Random(42);
+  auto uniform = [&](size_t Limit) { return Random() % Limit; };
+  auto randomColor = [&]() {
+    // Mostly dim colors, whose 16-bit fractions matter the most
+    return HSVColor(uniform(256), uniform(256), uniform(4) == 0 ? 255
+                                                                : uniform(32));
+  };
+
+  size_t Mismatches = 0;
+  for (size_t Time = 0; Time < Frames; ++Time) {
+    // Pick the changes first, then apply them to both arrays
+    std::vector<std::function<void(CheckArray<Deep> &)>> Changes;
+    for (size_t I = uniform(32); I > 0; --I) {
+      size_t Column = uniform(Coordinates::columns());
+      size_t Line = uniform(Coordinates::lines());
+      size_t Layer = uniform(3) == 0 ? 1 + uniform(Overlays) : 0;
+      HSVColor Color = randomColor();
+      bool Blink = uniform(8) == 0;
+      Changes.push_back([=](CheckArray<Deep> &Array) {
+        Array.setInLayer(Layer, Column, Line, Color, Blink);
+      });
+    }
+
+    if (uniform(8) == 0) {
+      size_t Strip = uniform(MaxPorts);
+      size_t Index = uniform(MaxLEDs);
+      Changes.push_back([=](CheckArray<Deep> &Array) {
+        Array.Strips[Strip].clearBlinking(Index);
+      });
+    }
+
+    if (uniform(16) == 0) {
+      for (size_t I = uniform(64); I > 0; --I) {
+        size_t Column = uniform(Coordinates::columns());
+        size_t Line = uniform(Coordinates::lines());
+        HSVColor Color = randomColor();
+        Changes.push_back([=](CheckArray<Deep> &Array) {
+          Array.setTarget(Column, Line, Color, false);
+        });
+      }
+      uint32_t TweenFrames = uniform(40);
+      Changes.push_back(
+          [=](CheckArray<Deep> &Array) { Array.startTween(TweenFrames); });
+    }
+
+    if (uniform(32) == 0) {
+      size_t Layer = 1 + uniform(Overlays);
+      LayerSettings Settings;
+      Settings.Opacity = uniform(256);
+      Settings.Keyed = uniform(2);
+      Settings.Key = randomColor().toRGBColor();
+      bool Clear = uniform(4) == 0;
+      Changes.push_back([=](CheckArray<Deep> &Array) {
+        Array.configureLayer(Layer, Settings, Clear);
+      });
+    }
+
+    if (uniform(32) == 0) {
+      uint8_t Brightness = uniform(256);
+      std::array<uint8_t, 3> Curves;
+      for (uint8_t &Curve : Curves)
+        Curve = uniform(Gamma::Curves.size());
+      Changes.push_back([=](CheckArray<Deep> &Array) {
+        Array.Stage.configure(Brightness, Curves);
+      });
+    }
+
+    if (uniform(64) == 0) {
+      uint32_t Budget = uniform(2) == 0 ? 0 : 2000 + uniform(20000);
+      Changes.push_back(
+          [=](CheckArray<Deep> &Array) { Array.MilliampBudget = Budget; });
+    }
+
+    for (auto &Change : Changes) {
+      Change(*Incremental);
+      Change(*Full);
+    }
+
+    for (auto &Strip : Full->Strips)
+      Strip.Dirty.setAll();
+    Incremental->render(Time);
+    Full->render(Time);
+
+    size_t Phase = Time % CheckArray<Deep>::StripType::Phases;
+    for (size_t J = 0; J < MaxPorts; ++J) {
+      const auto &Expected = Full->Strips[J].Encoded[Phase];
+      const auto &Actual = Incremental->Strips[J].Encoded[Phase];
+      for (size_t I = 0; I < MaxLEDs; ++I) {
+        if (Expected[I] == Actual[I])
+          continue;
+        RGBColor Want = WS2812::decode(Expected[I]);
+        RGBColor Got = WS2812::decode(Actual[I]);
+        fprintf(stderr,
+                "%d bits, frame %zu, strip %zu, LED %zu: expected %d/%d/%d, "
+                "got %d/%d/%d\n",
+                Deep ? 16 : 8, Time, J, I, Want.Red, Want.Green, Want.Blue,
+                Got.Red, Got.Green, Got.Blue);
+        ++Mismatches;
+        break;
+      }
+    }
+  }
+
+  return Mismatches;
+}
+
+int main(int Argc, char **Argv) {
+  size_t Frames = Argc > 1 ? strtoul(Argv[1], nullptr, 10) : 2000;
+
+  size_t Mismatches = check<false>(Frames) + check<true>(Frames);
+  printf("%zu frames of %zu strips of %zu LEDs, 8 and 16 bits: %zu "
+         "mismatches\n",
+         Frames, MaxPorts, MaxLEDs, Mismatches);
+  return Mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
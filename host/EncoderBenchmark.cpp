@@ -0,0 +1,122 @@
+// Measure the speed of FrameEncoder and the size of the command stream it
+// produces, compared to sending each frame in full.
+//
+// Usage: encoder-benchmark [--capture OUTPUT] [recording]
+//
+// With --capture, the command stream is also saved as a capture, with frames
+// 1/30 s apart, which can be replayed by the emulator. A recording is a
+// sequence of raw frames, each one made of Columns x Lines RGB triplets in
+// logical order. Without one, synthetic content is used: a static background,
+// a moving sprite and a scrolling ticker.
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#include "Capture.h"
+#include "FrameEncoder.h"
+#include "Recording.h"
+
+using Coordinates = LEDArray<MaxLEDs, MaxPorts>::TheCoordinateSystem;
+constexpr size_t Columns = Coordinates::columns();
+constexpr size_t Lines = Coordinates::lines();
+
+static std::vector<FrameEncoder::Frame> synthesize(size_t Count) {
+  std::vector<FrameEncoder::Frame> Result;
+  for (size_t Time = 0; Time < Count; ++Time) {
+    FrameEncoder::Frame Frame(Columns * Lines);
+    for (size_t Line = 0; Line < Lines; ++Line) {
+      for (size_t Column = 0; Column < Columns; ++Column) {
+        auto &LED = Frame[Line * Columns + Column];
+        LED.Color = HSVColor(Column * 3, 255, 16);
+
+        // Bouncing 6x6 sprite
+        size_t SpriteColumn = Time % (2 * (Columns - 6));
+        if (SpriteColumn >= Columns - 6)
+          SpriteColumn = 2 * (Columns - 6) - SpriteColumn;
+        size_t SpriteLine = (Time / 3) % (Lines - 6);
+        if (Column - SpriteColumn < 6 and Line - SpriteLine < 6)
+          LED.Color = HSVColor(0, 0, 200);
+
+        // Ticker on the last line, scrolling every other frame
+        if (Line == Lines - 1 and ((Column + Time / 2) / 3) % 4 == 0)
+          LED.Color = HSVColor(40, 255, 120);
+      }
+    }
+    Result.push_back(std::move(Frame));
+  }
+  return Result;
+}
+
+int main(int Argc, char **Argv) {
+  const char *CapturePath = nullptr;
+  const char *RecordingPath = nullptr;
+  for (int I = 1; I < Argc; ++I) {
+    if (strcmp(Argv[I], "--capture") == 0 and I + 1 < Argc)
+      CapturePath = Argv[++I];
+    else
+      RecordingPath = Argv[I];
+  }
+
+  std::vector<FrameEncoder::Frame> Frames;
+  if (RecordingPath == nullptr) {
+    Frames = synthesize(2000);
+  } else if (not Recording::load(RecordingPath, Columns, Lines, Frames)) {
+    perror(RecordingPath);
+    return EXIT_FAILURE;
+  }
+
+  if (Frames.empty()) {
+    fprintf(stderr, "No frames\n");
+    return EXIT_FAILURE;
+  }
+
+  FrameEncoder Encoder(Columns, Lines);
+  FrameEncoder::Stream Output;
+  FrameEncoder::Frame Previous = Encoder.blankFrame();
+
+  using namespace std::chrono;
+  size_t TotalBytes = 0;
+  auto Start = steady_clock::now();
+  for (const auto &Frame : Frames) {
+    Output.clear();
+    Encoder.encode(Previous, Frame, Output);
+    TotalBytes += Output.size();
+    Previous = Frame;
+  }
+  double Elapsed = duration<double, std::micro>(steady_clock::now() - Start)
+                       .count();
+
+  // Sending every line in full takes a MoveCursor and an UpdateRange
+  size_t FullFrameBytes =
+      Lines * (FrameEncoder::SplitCost + Columns * sizeof(LEDDescriptor));
+
+  printf("%zu frames of %zux%zu\n", Frames.size(), Columns, Lines);
+
+  if (CapturePath != nullptr) {
+    FILE *File = fopen(CapturePath, "wb");
+    if (File == nullptr) {
+      perror(CapturePath);
+      return EXIT_FAILURE;
+    }
+
+    Capture::Writer Writer(File);
+    FrameEncoder CaptureEncoder(Columns, Lines);
+    Previous = CaptureEncoder.blankFrame();
+    Output.clear();
+    CaptureEncoder.helo(Output);
+    for (size_t I = 0; I < Frames.size(); ++I) {
+      CaptureEncoder.encode(Previous, Frames[I], Output);
+      Writer.write(I * 1000000 / 30, Output.data(), Output.size());
+      Output.clear();
+      Previous = Frames[I];
+    }
+    fclose(File);
+  }
+  printf("encode time: %.2f us/frame\n", Elapsed / Frames.size());
+  printf("bytes/frame: %.1f (full frame: %zu, %.1f%%)\n",
+         double(TotalBytes) / Frames.size(), FullFrameBytes,
+         100.0 * TotalBytes / Frames.size() / FullFrameBytes);
+
+  return EXIT_SUCCESS;
+}
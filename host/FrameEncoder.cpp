@@ -0,0 +1,157 @@
+#include "FrameEncoder.h"
+
+using namespace Command;
+
+void FrameEncoder::command(identifier_t ID, const void *Payload,
+                           length_t Length, Stream &Output) {
+  assert(HeaderSize + Length <= Framing::MaxPayload);
+  if (Commands.size() + HeaderSize + Length > Framing::MaxPayload)
+    flush(Output);
+
+  const auto *Bytes = static_cast<const uint8_t *>(Payload);
+  Commands.push_back(ID);
+  Commands.insert(Commands.end(), reinterpret_cast<const uint8_t *>(&Length),
+                  reinterpret_cast<const uint8_t *>(&Length + 1));
+  Commands.insert(Commands.end(), Bytes, Bytes + Length);
+}
+
+void FrameEncoder::flush(Stream &Output) {
+  if (Commands.empty())
+    return;
+  Framing::encode(Commands.data(), Commands.size(), Output);
+  Commands.clear();
+}
+
+void FrameEncoder::helo(Stream &Output) {
+  const std::array<uint8_t, 4> Payload = {'H', 'E', 'L', 'O'};
+  command(ids::Helo, &Payload, sizeof(Payload), Output);
+  flush(Output);
+}
+
+void FrameEncoder::uploadAnimation(const std::vector<uint8_t> &Image,
+                                   Stream &Output) {
+  command(ids::UploadAnimation, nullptr, 0, Output);
+  constexpr size_t ChunkSize = Framing::MaxPayload - HeaderSize;
+  for (size_t Offset = 0; Offset < Image.size(); Offset += ChunkSize) {
+    size_t Size = std::min(ChunkSize, Image.size() - Offset);
+    command(ids::UploadAnimation, &Image[Offset], Size, Output);
+  }
+  flush(Output);
+}
+
+void FrameEncoder::playAnimation(PlayAnimationMessage::Modes Mode,
+                                 Stream &Output) {
+  PlayAnimationMessage Message;
+  Message.Mode = Mode;
+  command(ids::PlayAnimation, &Message, sizeof(Message), Output);
+  flush(Output);
+}
+
+void FrameEncoder::selectLayer(uint8_t Layer, Stream &Output) {
+  SelectLayerMessage Message;
+  Message.Layer = Layer;
+  command(ids::SelectLayer, &Message, sizeof(Message), Output);
+}
+
+void FrameEncoder::configureLayer(uint8_t Layer, const LayerSettings &Settings,
+                                  bool Clear, Stream &Output) {
+  ConfigureLayerMessage Message;
+  Message.Layer = Layer;
+  Message.Opacity = Settings.Opacity;
+  Message.Flags = (Settings.Keyed ? ConfigureLayerMessage::Keyed : 0) |
+                  (Clear ? ConfigureLayerMessage::Clear : 0);
+  Message.Key = Settings.Key;
+  command(ids::ConfigureLayer, &Message, sizeof(Message), Output);
+}
+
+void FrameEncoder::setTile(cursor_t TileOrigin, bool Synchronized,
+                           Stream &Output) {
+  TileMessage Message;
+  Message.Origin = TileOrigin;
+  Message.Synchronized = Synchronized;
+  command(ids::SetTile, &Message, sizeof(Message), Output);
+  flush(Output);
+}
+
+void FrameEncoder::present(Stream &Output) {
+  command(ids::Present, nullptr, 0, Output);
+  flush(Output);
+}
+
+void FrameEncoder::encode(const Frame &Previous, const Frame &Next,
+                          Stream &Output) {
+  encodeRuns(Previous, Next, ids::UpdateRange, Output);
+  flush(Output);
+}
+
+void FrameEncoder::tween(const Frame &Previous, const Frame &Next,
+                         uint32_t Frames, Stream &Output) {
+  encodeRuns(Previous, Next, ids::UpdateTarget, Output);
+  TweenMessage Message{Frames};
+  command(ids::Tween, &Message, sizeof(Message), Output);
+  flush(Output);
+}
+
+void FrameEncoder::encodeRuns(const Frame &Previous, const Frame &Next,
+                              identifier_t RunCommand, Stream &Output) {
+  assert(Previous.size() == Columns * Lines);
+  assert(Next.size() == Columns * Lines);
+
+  for (size_t Line = 0; Line < Lines; ++Line) {
+    const LEDDescriptor *Old = &Previous[Line * Columns];
+    const LEDDescriptor *New = &Next[Line * Columns];
+    auto Changed = [&](size_t Column) {
+      return not(Old[Column] == New[Column]);
+    };
+
+    size_t Column = 0;
+    while (true) {
+      while (Column < Columns and not Changed(Column))
+        ++Column;
+      if (Column == Columns)
+        break;
+
+      // Extend the run over each gap of unchanged LEDs that costs less to
+      // resend than starting over with a new run after it
+      size_t Start = Column;
+      size_t End = Column + 1;
+      while (End < Columns) {
+        size_t NextChange = End;
+        while (NextChange < Columns and not Changed(NextChange))
+          ++NextChange;
+        if (NextChange == Columns)
+          break;
+
+        size_t GapCost = (NextChange - End) * sizeof(LEDDescriptor);
+        if (GapCost > SplitCost)
+          break;
+        End = NextChange + 1;
+      }
+
+      emitRun(Next, RunCommand, Line, Start, End, Output);
+      Column = End;
+    }
+  }
+}
+
+void FrameEncoder::emitRun(const Frame &Next, identifier_t RunCommand,
+                           size_t Line, size_t Start, size_t End,
+                           Stream &Output) {
+  // Lines of a large canvas do not fit in a single command
+  constexpr size_t MaxRun =
+      (Framing::MaxPayload - HeaderSize) / sizeof(LEDDescriptor);
+  for (; Start < End; Start += MaxRun) {
+    cursor_t RunStart{static_cast<uint32_t>(Origin.Column + Start),
+                      static_cast<uint32_t>(Origin.Line + Line)};
+    if (not Cursor or Cursor->Column != RunStart.Column or
+        Cursor->Line != RunStart.Line) {
+      command(ids::MoveCursor, &RunStart, sizeof(RunStart), Output);
+      Cursor = RunStart;
+    }
+
+    // Runs do not move the cursor of the device
+    size_t Size = std::min(MaxRun, End - Start);
+    command(RunCommand, &Next[Line * Columns + Start],
+            Size * sizeof(LEDDescriptor), Output);
+  }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <optional>
+#include <stdint.h>
+#include <vector>
+
+#include "Framing.h"
+#include "LED.h"
+#include "Protocol.h"
+
+/// Turns a sequence of frames into the shortest command stream updating the
+/// device from one frame to the next.
+///
+/// Frames are in logical coordinates, i.e., Frame[Line * Columns + Column].
+/// Changed LEDs are sent as UpdateRange (or UpdateTarget) runs, each one
+/// preceded by a MoveCursor. Runs of changed LEDs on the same line are merged
+/// whenever resending the unchanged LEDs in between is cheaper than starting a
+/// new run.
+/// The commands are packed in as few protocol frames (see Framing.h) as
+/// possible.
+class FrameEncoder {
+public:
+  using Frame = std::vector<LEDDescriptor>;
+  using Stream = std::vector<uint8_t>;
+
+  static constexpr size_t HeaderSize =
+      sizeof(Command::identifier_t) + sizeof(Command::length_t);
+
+  /// Bytes needed to start a new run instead of extending the current one
+  static constexpr size_t SplitCost =
+      HeaderSize + sizeof(Command::cursor_t) + HeaderSize;
+
+private:
+  size_t Columns;
+  size_t Lines;
+
+  /// Where the frames are in the canvas, for tiles (see TileMessage)
+  Command::cursor_t Origin;
+
+  /// Where the write cursor of the device is, if known
+  std::optional<Command::cursor_t> Cursor;
+
+  /// Commands of the protocol frame being built
+  Stream Commands;
+
+public:
+  FrameEncoder(size_t Columns, size_t Lines,
+               Command::cursor_t Origin = {0, 0})
+      : Columns(Columns), Lines(Lines), Origin(Origin) {}
+
+public:
+  Frame blankFrame() const { return Frame(Columns * Lines); }
+
+  /// Append the handshake that has to start every stream
+  void helo(Stream &Output);
+
+  /// Append the commands turning Previous into Next
+  void encode(const Frame &Previous, const Frame &Next, Stream &Output);
+
+  /// Append the commands making the device transition from Previous to Next
+  /// over Frames frames: the changed LEDs are sent as UpdateTarget runs,
+  /// followed by a Tween
+  void tween(const Frame &Previous, const Frame &Next, uint32_t Frames,
+             Stream &Output);
+
+  /// Append the commands uploading Image, an animation in the format of
+  /// main/Animation.h, to the device
+  void uploadAnimation(const std::vector<uint8_t> &Image, Stream &Output);
+
+  /// Append the command starting (or, with Stop, stopping) the animation
+  void playAnimation(Command::PlayAnimationMessage::Modes Mode,
+                     Stream &Output);
+
+  /// Append the command making the following encode calls write to Layer
+  void selectLayer(uint8_t Layer, Stream &Output);
+
+  /// Append the command changing the settings of overlay Layer
+  void configureLayer(uint8_t Layer, const LayerSettings &Settings,
+                      bool Clear, Stream &Output);
+
+  /// Append the command making the device a tile of a canvas, its LEDs
+  /// starting at TileOrigin
+  void setTile(Command::cursor_t TileOrigin, bool Synchronized,
+               Stream &Output);
+
+  /// Append the command showing the frame on a synchronized tile
+  void present(Stream &Output);
+
+  /// Forget what is known about the state of the device
+  void reset() { Cursor.reset(); }
+
+private:
+  void command(Command::identifier_t ID, const void *Payload,
+               Command::length_t Length, Stream &Output);
+  void flush(Stream &Output);
+
+  void encodeRuns(const Frame &Previous, const Frame &Next,
+                  Command::identifier_t RunCommand, Stream &Output);
+  void emitRun(const Frame &Next, Command::identifier_t RunCommand,
+               size_t Line, size_t Start, size_t End, Stream &Output);
+};
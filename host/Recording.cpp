@@ -0,0 +1,26 @@
+#include <stdio.h>
+
+#include "Recording.h"
+
+namespace Recording {
+
+bool load(const char *Path, size_t Columns, size_t Lines,
+          std::vector<FrameEncoder::Frame> &Frames) {
+  FILE *File = fopen(Path, "rb");
+  if (File == nullptr)
+    return false;
+
+  std::vector<RGBColor> Pixels(Columns * Lines);
+  while (fread(Pixels.data(), sizeof(RGBColor), Pixels.size(), File) ==
+         Pixels.size()) {
+    FrameEncoder::Frame Frame;
+    for (const RGBColor &Pixel : Pixels)
+      Frame.emplace_back(Pixel);
+    Frames.push_back(std::move(Frame));
+  }
+
+  fclose(File);
+  return true;
+}
+
+} // namespace Recording
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <vector>
+
+#include "FrameEncoder.h"
+
+/// Raw recordings of what is to be shown: a sequence of frames, each one made
+/// of Columns x Lines RGB triplets in logical order.
+namespace Recording {
+
+/// Append the frames of the recording at Path to Frames, returns false if it
+/// cannot be read
+bool load(const char *Path, size_t Columns, size_t Lines,
+          std::vector<FrameEncoder::Frame> &Frames);
+
+} // namespace Recording
@@ -0,0 +1,110 @@
+// Measure the time to render a frame as a function of the number of render
+// threads, when every LED has to be re-encoded, when only a few did change
+// and when a static background is covered by a moving, half transparent
+// overlay. Each scenario is run with 8-bit LEDs and with 16-bit ones, which
+// are dithered (see DeepColor): ns/LED is the time per LED of the strips.
+//
+// Usage: render-benchmark [frames [max-threads]]
+
+#include <memory>
+#include <random>
+#include <thread>
+
+#include "LED.h"
+
+// Larger than the real strips, so that there is enough work to split
+constexpr size_t BenchmarkLEDs = 4096;
+template <bool Deep>
+using BenchmarkArray = LEDArray<BenchmarkLEDs, MaxPorts, Deep>;
+
+enum class Scenario { Full, Sparse, Overlay };
+
+// LEDs of the moving overlay on each strip
+constexpr size_t SpriteLEDs = 64;
+
+template <bool Deep>
+static double measure(size_t Threads, Scenario TheScenario, size_t Frames) {
+  auto Array = std::make_unique<BenchmarkArray<Deep>>();
+  Array->setRenderThreads(Threads);
+
+  std::mt19937 Random(42);
+  auto randomColor = [&Random]() {
+    using StoredColor = typename BenchmarkArray<Deep>::StoredColor;
+    using Channel = decltype(StoredColor::Red);
+    return StoredColor(Channel(Random()), Channel(Random()), Channel(Random()));
+  };
+  for (auto &Strip : Array->Strips)
+    for (size_t I = 0; I < BenchmarkLEDs; ++I)
+      Strip.write(I, randomColor());
+
+  LayerSettings Settings;
+  Settings.Opacity = 128;
+  Array->configureLayer(1, Settings, false);
+  if (TheScenario == Scenario::Overlay)
+    for (auto &Strip : Array->Strips)
+      for (size_t I = 0; I < SpriteLEDs; ++I)
+        Strip.writeOverlay(0, I, RGBColor(255, 255, 255), false);
+  Array->render(0);
+
+  using namespace std::chrono;
+  nanoseconds Total{0};
+  for (size_t Frame = 1; Frame <= Frames; ++Frame) {
+    if (TheScenario == Scenario::Full) {
+      // A new brightness invalidates all the encoded LEDs
+      Array->Stage.configure(200 + Frame % 2, {0, 0, 0});
+    } else if (TheScenario == Scenario::Overlay) {
+      // Move the sprite by one LED
+      for (auto &Strip : Array->Strips) {
+        size_t Start = (Frame - 1) % (BenchmarkLEDs - SpriteLEDs);
+        Strip.writeOverlay(0, Start, {}, true);
+        Strip.writeOverlay(0, Start + SpriteLEDs, RGBColor(255, 255, 255),
+                           false);
+      }
+    } else {
+      for (size_t I = 0; I < BenchmarkLEDs / 100; ++I) {
+        auto &Strip = Array->Strips[Random() % MaxPorts];
+        Strip.write(Random() % BenchmarkLEDs, randomColor());
+      }
+    }
+
+    auto Start = steady_clock::now();
+    Array->render(Frame);
+    Total += steady_clock::now() - Start;
+  }
+
+  return duration<double, std::micro>(Total).count() / Frames;
+}
+
+int main(int Argc, char **Argv) {
+  size_t Frames = Argc > 1 ? strtoul(Argv[1], nullptr, 10) : 2000;
+  size_t MaxThreads = Argc > 2 ? strtoul(Argv[2], nullptr, 10)
+                               : std::thread::hardware_concurrency();
+  MaxThreads = std::clamp<size_t>(MaxThreads, 1,
+                                  Scheduler<1, 1>::MaxWorkers + 1);
+
+  printf("%zu strips of %zu LEDs, %zu frames\n", MaxPorts, BenchmarkLEDs,
+         Frames);
+  printf("%-8s %-5s %-8s %12s %8s %8s\n", "scenario", "bits", "threads",
+         "us/frame", "ns/LED", "speedup");
+
+  for (Scenario TheScenario :
+       {Scenario::Full, Scenario::Sparse, Scenario::Overlay}) {
+    const char *Name = TheScenario == Scenario::Full     ? "full"
+                       : TheScenario == Scenario::Sparse ? "sparse"
+                                                         : "overlay";
+    for (bool Deep : {false, true}) {
+      double Baseline = 0;
+      for (size_t Threads = 1; Threads <= MaxThreads; ++Threads) {
+        double Time = Deep ? measure<true>(Threads, TheScenario, Frames)
+                           : measure<false>(Threads, TheScenario, Frames);
+        if (Threads == 1)
+          Baseline = Time;
+        printf("%-8s %-5d %-8zu %12.2f %8.2f %8.2f\n", Name, Deep ? 16 : 8,
+               Threads, Time, Time * 1000 / (MaxPorts * BenchmarkLEDs),
+               Baseline / Time);
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
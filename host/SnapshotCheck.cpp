@@ -0,0 +1,85 @@
+// Check what the boot frame brings back in each mode, through a snapshot file.
+//
+// Usage: snapshot-check [file]
+//
+// A frame is saved automatically and must be restored as is, then
+// SetBootFrame's Disabled mode must have the next boot start with the LEDs
+// off, rather than with nothing saved, which would show the test pattern.
+
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Snapshot.h"
+
+using CheckArray = LEDArray<MaxLEDs, MaxPorts>;
+using CheckKeeper = Snapshot::Keeper<MaxLEDs, MaxPorts>;
+
+/// Boot a fresh array from the snapshot file, returns what has been found
+static Snapshot::Boot boot(CheckArray &LEDs) {
+  auto Keeper = std::make_unique<CheckKeeper>();
+  Snapshot::Boot Found = Keeper->restore(LEDs);
+  LEDs.render(0);
+  return Found;
+}
+
+/// Whether all the LEDs sent to the strips are off
+static bool dark(const CheckArray &LEDs) {
+  for (const auto &Strip : LEDs.Strips)
+    for (size_t I = 0; I < LEDs.size(); ++I)
+      if (not(WS2812::decode(Strip.Encoded[0][I]) == RGBColor()))
+        return false;
+  return true;
+}
+
+int main(int Argc, char **Argv) {
+  const char *File = Argc > 1 ? Argv[1] : "snapshot-check.bin";
+  Snapshot::HostFile = File;
+  unlink(File);
+
+  bool Passed = true;
+  auto expect = [&Passed](const char *What, bool Condition) {
+    printf("%-40s %s\n", What, Condition ? "ok" : "FAILED");
+    Passed = Passed and Condition;
+  };
+
+  {
+    auto LEDs = std::make_unique<CheckArray>();
+    Snapshot::Boot Found = boot(*LEDs);
+    expect("nothing saved is missing", Found == Snapshot::Boot::Missing);
+  }
+
+  // Save a frame as it happens while running, once it is stable
+  {
+    auto LEDs = std::make_unique<CheckArray>();
+    auto Keeper = std::make_unique<CheckKeeper>();
+    LEDs->Strips[1].set(5, RGBColor(10, 20, 30));
+    LEDs->render(0);
+    Keeper->update(*LEDs, 0);
+    Keeper->update(*LEDs, Snapshot::StableMicros);
+  }
+
+  {
+    auto LEDs = std::make_unique<CheckArray>();
+    Snapshot::Boot Found = boot(*LEDs);
+    expect("a stable frame is restored", Found == Snapshot::Boot::Restored);
+    expect("the restored frame matches",
+           LEDs->Strips[1].LEDs[5] == RGBColor(10, 20, 30));
+
+    // SetBootFrame with Disabled
+    auto Keeper = std::make_unique<CheckKeeper>();
+    Keeper->restore(*LEDs);
+    Keeper->setMode(Snapshot::Modes::Disabled, *LEDs);
+  }
+
+  {
+    auto LEDs = std::make_unique<CheckArray>();
+    Snapshot::Boot Found = boot(*LEDs);
+    expect("a disabled snapshot starts dark", Found == Snapshot::Boot::Dark);
+    expect("the LEDs stay off", dark(*LEDs));
+  }
+
+  unlink(File);
+  return Passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,282 @@
+// Emulate a wall made of several controllers, each one a tile of the canvas
+// (see TileMessage), to check that the tiles flip together and to measure how
+// throughput scales with the number of tiles.
+//
+// Usage: tile-harness [--baud BAUD] [frames [max-tiles]]
+//
+// Tiles are laid side by side. Each one runs the firmware's parser and
+// renderer in its own process, fed through a pipe, in synchronized mode: a
+// Present follows every frame of the canvas. After each rendered frame, a tile
+// checks that its strips show exactly the part of the last presented frame
+// that belongs to it.
+//
+// Two ways of feeding the tiles are compared: "split", where each tile gets
+// only the commands for its LEDs, as through a link of its own, and
+// "broadcast", where all the tiles get the whole canvas and clip it. Since
+// tiles run in parallel on real hardware, the frame rate is estimated from the
+// slowest tile, either its CPU time per frame or the time its link, at BAUD,
+// takes to carry one frame, whichever is larger.
+
+#include <algorithm>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+#include "Command.h"
+#include "FrameEncoder.h"
+
+using Coordinates = LEDArray<MaxLEDs, MaxPorts>::TheCoordinateSystem;
+constexpr size_t TileColumns = Coordinates::columns();
+constexpr size_t TileLines = Coordinates::lines();
+
+static std::array<std::array<RGBColor, MaxLEDs>, MaxPorts> Physical;
+
+static void sink(size_t Gpio, ArrayRef<const uint8_t> Buffer) {
+  const auto *LEDs = reinterpret_cast<const WS2812::EncodedLED *>(Buffer.Data);
+  size_t Count = Buffer.Size / sizeof(WS2812::EncodedLED);
+  for (size_t I = 0; I < Count; ++I)
+    Physical[Gpio][I] = WS2812::decode(LEDs[I]);
+}
+
+/// Frames of a canvas of Tiles tiles, where every LED changes at each frame
+static std::vector<FrameEncoder::Frame> synthesize(size_t Tiles,
+                                                   size_t Count) {
+  size_t Columns = TileColumns * Tiles;
+  std::vector<FrameEncoder::Frame> Result;
+  for (size_t Time = 0; Time < Count; ++Time) {
+    FrameEncoder::Frame Frame(Columns * TileLines);
+    for (size_t Line = 0; Line < TileLines; ++Line)
+      for (size_t Column = 0; Column < Columns; ++Column)
+        Frame[Line * Columns + Column].Color =
+            HSVColor((Column * 2 + Line * 5 + Time * 7) % 256, 255,
+                     32 + (Time + Column) % 64);
+    Result.push_back(std::move(Frame));
+  }
+  return Result;
+}
+
+/// The part of Frame belonging to Tile
+static FrameEncoder::Frame crop(const FrameEncoder::Frame &Frame,
+                                size_t Tiles, size_t Tile) {
+  size_t Columns = TileColumns * Tiles;
+  FrameEncoder::Frame Result(TileColumns * TileLines);
+  for (size_t Line = 0; Line < TileLines; ++Line)
+    for (size_t Column = 0; Column < TileColumns; ++Column)
+      Result[Line * TileColumns + Column] =
+          Frame[Line * Columns + Tile * TileColumns + Column];
+  return Result;
+}
+
+struct TileResult {
+  /// Frames rendered after the first Present
+  uint32_t Frames = 0;
+  /// Frames not matching the last presented one
+  uint32_t Mismatches = 0;
+};
+
+/// Body of the process emulating Tile, never returns
+[[noreturn]] static void runTile(int Input, int Report,
+                                 const std::vector<FrameEncoder::Frame> &Frames,
+                                 size_t Tiles, size_t Tile) {
+  // Drop the acknowledgments
+  freopen("/dev/null", "w", stdout);
+  Command::setInput(Input);
+  HostPinSink = &sink;
+  start_time = ledian_clock::now();
+
+  TileResult Result;
+  size_t Time = 0;
+  auto check = [&]() {
+    uint32_t Presents = Statistics.Commands[Command::ids::Present];
+    if (Presents == 0)
+      return;
+    ++Result.Frames;
+
+    FrameEncoder::Frame Expected = crop(Frames[Presents - 1], Tiles, Tile);
+    for (size_t Line = 0; Line < TileLines; ++Line) {
+      for (size_t Column = 0; Column < TileColumns; ++Column) {
+        LEDCoordinate Coordinate = Coordinates::convert(Point{Column, Line});
+        RGBColor Color = WS2812::decode(WS2812::encode(LEDs.Stage.apply(
+            Expected[Line * TileColumns + Column].Color.toRGBColor())));
+        if (not(Physical[Coordinate.StripIndex][Coordinate.LEDIndex] ==
+                Color)) {
+          ++Result.Mismatches;
+          return;
+        }
+      }
+    }
+  };
+
+  while (Command::parse()) {
+    if (Command::frameReady()) {
+      LEDs.render(Time++);
+      Command::frameDone();
+      check();
+    }
+  }
+
+  write(Report, &Result, sizeof(Result));
+  _exit(EXIT_SUCCESS);
+}
+
+static void feed(int Output, const FrameEncoder::Stream &Stream) {
+  for (size_t Written = 0; Written < Stream.size();) {
+    ssize_t Result =
+        write(Output, Stream.data() + Written, Stream.size() - Written);
+    if (Result <= 0)
+      break;
+    Written += Result;
+  }
+  close(Output);
+}
+
+struct Measurement {
+  bool Passed = true;
+  size_t MaxBytes = 0;
+  double MaxCPUMicros = 0;
+};
+
+/// Run one process per stream and collect how they did
+static Measurement run(const std::vector<FrameEncoder::Stream> &Streams,
+                       const std::vector<FrameEncoder::Frame> &Frames) {
+  size_t Tiles = Streams.size();
+  std::vector<pid_t> Children;
+  std::vector<int> Inputs;
+  std::vector<int> Reports;
+  for (size_t Tile = 0; Tile < Tiles; ++Tile) {
+    int Data[2];
+    int Report[2];
+    if (pipe(Data) != 0 or pipe(Report) != 0) {
+      perror("pipe");
+      exit(EXIT_FAILURE);
+    }
+
+    fflush(stdout);
+    pid_t Child = fork();
+    if (Child < 0) {
+      perror("fork");
+      exit(EXIT_FAILURE);
+    }
+    if (Child == 0) {
+      close(Data[1]);
+      close(Report[0]);
+      for (int Input : Inputs)
+        close(Input);
+      runTile(Data[0], Report[1], Frames, Tiles, Tile);
+    }
+
+    close(Data[0]);
+    close(Report[1]);
+    Children.push_back(Child);
+    Inputs.push_back(Data[1]);
+    Reports.push_back(Report[0]);
+  }
+
+  std::vector<std::thread> Feeders;
+  for (size_t Tile = 0; Tile < Tiles; ++Tile)
+    Feeders.emplace_back(feed, Inputs[Tile], std::cref(Streams[Tile]));
+
+  Measurement Result;
+  for (size_t Tile = 0; Tile < Tiles; ++Tile) {
+    int Status = 0;
+    rusage Usage;
+    wait4(Children[Tile], &Status, 0, &Usage);
+
+    TileResult Report;
+    if (read(Reports[Tile], &Report, sizeof(Report)) != sizeof(Report) or
+        Report.Frames != Frames.size() or Report.Mismatches != 0) {
+      fprintf(stderr, "tile %zu of %zu: %u frames, %u mismatches\n", Tile,
+              Tiles, Report.Frames, Report.Mismatches);
+      Result.Passed = false;
+    }
+    close(Reports[Tile]);
+
+    double CPUMicros = Usage.ru_utime.tv_sec * 1e6 + Usage.ru_utime.tv_usec +
+                       Usage.ru_stime.tv_sec * 1e6 + Usage.ru_stime.tv_usec;
+    Result.MaxCPUMicros = std::max(Result.MaxCPUMicros, CPUMicros);
+    Result.MaxBytes = std::max(Result.MaxBytes, Streams[Tile].size());
+  }
+
+  for (std::thread &Feeder : Feeders)
+    Feeder.join();
+  return Result;
+}
+
+int main(int Argc, char **Argv) {
+  unsigned long Baud = 115200;
+  size_t FrameCount = 100;
+  size_t MaxTiles = 8;
+  size_t Positional = 0;
+  for (int I = 1; I < Argc; ++I) {
+    if (strcmp(Argv[I], "--baud") == 0 and I + 1 < Argc)
+      Baud = strtoul(Argv[++I], nullptr, 10);
+    else if (Positional++ == 0)
+      FrameCount = strtoul(Argv[I], nullptr, 10);
+    else
+      MaxTiles = strtoul(Argv[I], nullptr, 10);
+  }
+
+  if (FrameCount == 0 or MaxTiles == 0 or Baud == 0) {
+    fprintf(stderr, "Usage: %s [--baud BAUD] [frames [max-tiles]]\n",
+            Argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // 10 bits per byte on the wire
+  double LinkBytesPerSecond = Baud / 10.0;
+
+  printf("tiles of %zux%zu LEDs, %zu frames, %lu baud\n", TileColumns,
+         TileLines, FrameCount, Baud);
+  printf("%-6s %-10s %12s %12s %10s %12s\n", "tiles", "mode", "bytes/frame",
+         "cpu us/frame", "frames/s", "LEDs/s");
+
+  bool Passed = true;
+  for (size_t Tiles = 1; Tiles <= MaxTiles; Tiles *= 2) {
+    std::vector<FrameEncoder::Frame> Frames = synthesize(Tiles, FrameCount);
+    size_t Columns = TileColumns * Tiles;
+
+    for (bool Broadcast : {false, true}) {
+      std::vector<FrameEncoder::Stream> Streams(Tiles);
+      for (size_t Tile = 0; Tile < Tiles; ++Tile) {
+        Command::cursor_t Origin{uint32_t(Tile * TileColumns), 0};
+        FrameEncoder::Stream &Stream = Streams[Tile];
+        FrameEncoder Encoder = Broadcast
+                                   ? FrameEncoder(Columns, TileLines)
+                                   : FrameEncoder(TileColumns, TileLines,
+                                                  Origin);
+        Encoder.helo(Stream);
+        Encoder.setTile(Origin, true, Stream);
+
+        FrameEncoder::Frame Previous = Encoder.blankFrame();
+        for (const FrameEncoder::Frame &Canvas : Frames) {
+          FrameEncoder::Frame Next =
+              Broadcast ? Canvas : crop(Canvas, Tiles, Tile);
+          Encoder.encode(Previous, Next, Stream);
+          Encoder.present(Stream);
+          Previous = std::move(Next);
+        }
+      }
+
+      Measurement Result = run(Streams, Frames);
+      Passed = Passed and Result.Passed;
+
+      double BytesPerFrame = double(Result.MaxBytes) / FrameCount;
+      double CPUMicrosPerFrame = Result.MaxCPUMicros / FrameCount;
+      double FrameMicros = std::max(CPUMicrosPerFrame,
+                                    BytesPerFrame / LinkBytesPerSecond * 1e6);
+      double FramesPerSecond = 1e6 / FrameMicros;
+      printf("%-6zu %-10s %12.0f %12.1f %10.2f %12.0f\n", Tiles,
+             Broadcast ? "broadcast" : "split", BytesPerFrame,
+             CPUMicrosPerFrame, FramesPerSecond,
+             FramesPerSecond * Tiles * TileColumns * TileLines);
+    }
+  }
+
+  if (not Passed) {
+    fprintf(stderr, "Some tiles did not show the expected frames\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""Measure end-to-end latency with the Probe command.
+
+Each probe updates a pixel and is followed by a Probe carrying a sequence
+number. The device replies once the frame including the probe has been
+flushed, with timestamps for header reception, end of parsing, start of the
+render and end of the flush. The script prints the breakdown of each stage
+along with the round trip seen from the host.
+
+Usage: probe.py [--baud 115200] [--count 100] [--interval 0.05] PORT
+"""
+
+import argparse
+import struct
+import time
+
+from stats import command
+
+HELO = 1
+UPDATE_RANGE = 2
+MOVE_CURSOR = 3
+PROBE = 8
+
+# Mirrors struct ProbeReply in main/Protocol.h
+PROBE_REPLY_FORMAT = "<IIQQQQ"
+assert struct.calcsize(PROBE_REPLY_FORMAT) == 40
+
+STAGES = ["parse", "queue+render", "flush", "round trip"]
+
+
+def probe(port, sequence):
+    # Toggle the first pixel, so that every probe carries an actual change
+    value = 255 if sequence % 2 else 0
+    port.write(command(MOVE_CURSOR, struct.pack("<II", 0, 0)) +
+               command(UPDATE_RANGE, bytes([0, 0, value, 0])) +
+               command(PROBE, struct.pack("<I", sequence)))
+    sent = time.monotonic()
+
+    deadline = sent + 2
+    while time.monotonic() < deadline:
+        line = port.readline().decode("ascii", errors="replace").strip()
+        if not line.startswith("PROBE "):
+            continue
+        reply = struct.unpack(PROBE_REPLY_FORMAT,
+                              bytes.fromhex(line[len("PROBE "):]))
+        received = time.monotonic()
+        replied_sequence, _, header, parsed, rendered, flushed = reply
+        if replied_sequence != sequence:
+            continue
+        return [parsed - header, rendered - parsed, flushed - rendered,
+                (received - sent) * 1e6]
+    raise TimeoutError("no reply to probe %d" % sequence)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--count", type=int, default=100)
+    parser.add_argument("--interval", type=float, default=0.05)
+    args = parser.parse_args()
+
+    import serial
+    port = serial.Serial(args.port, args.baud, timeout=0.5)
+    port.write(command(HELO, b"HELO"))
+
+    samples = []
+    for sequence in range(args.count):
+        samples.append(probe(port, sequence))
+        time.sleep(args.interval)
+
+    print("%-14s %10s %10s %10s" % ("stage (us)", "min", "avg", "max"))
+    for index, stage in enumerate(STAGES):
+        values = [sample[index] for sample in samples]
+        print("%-14s %10.0f %10.0f %10.0f" % (stage, min(values),
+                                               sum(values) / len(values),
+                                               max(values)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""Poll the runtime statistics of a device through the GetStats command.
+
+Prints frame rate, throughput and timing figures once per period and, with
+--plot, draws them live. Requires pyserial (and matplotlib for --plot).
+
+Usage: stats.py [--baud 115200] [--period 1.0] [--plot] PORT
+"""
+
+import argparse
+import struct
+import sys
+import time
+import zlib
+
+HELO = 1
+GET_STATS = 7
+
+COMMAND_NAMES = {
+    1: "Helo",
+    2: "UpdateRange",
+    3: "MoveCursor",
+    4: "Configure",
+    5: "SetOutput",
+    6: "SetPowerBudget",
+    7: "GetStats",
+    8: "Probe",
+    9: "UpdateTarget",
+    10: "Tween",
+    11: "UploadAnimation",
+    12: "PlayAnimation",
+    13: "SetBootFrame",
+    14: "SelectLayer",
+    15: "ConfigureLayer",
+    16: "SetTile",
+    17: "Present",
+}
+
+# Mirrors struct Stats in main/Stats.h
+MAX_COMMANDS = 24
+TIME_STATS = "QIIII"
+STATS_FORMAT = ("<QQIIIIII" + "I" * MAX_COMMANDS + TIME_STATS * 3 + "IIII" +
+                "II")
+assert struct.calcsize(STATS_FORMAT) == 232
+
+
+def cobs_encode(data):
+    result = bytearray()
+    block = bytearray()
+    for byte in data:
+        if byte == 0:
+            result += bytes([len(block) + 1]) + block
+            block = bytearray()
+        else:
+            block.append(byte)
+            if len(block) == 254:
+                result += b"\xff" + block
+                block = bytearray()
+    result += bytes([len(block) + 1]) + block
+    return bytes(result)
+
+
+def frame(commands):
+    """Wrap commands in a frame, see main/Framing.h"""
+    crc = struct.pack("<I", zlib.crc32(commands))
+    return cobs_encode(commands + crc) + b"\x00"
+
+
+def command(identifier, payload=b""):
+    return frame(struct.pack("<BI", identifier, len(payload)) + payload)
+
+
+def parse_time_stats(values):
+    total, count, minimum, maximum, last = values
+    return {
+        "count": count,
+        "min": minimum if count else 0,
+        "avg": total / count if count else 0,
+        "max": maximum,
+        "last": last,
+    }
+
+
+def parse_stats(data):
+    values = struct.unpack(STATS_FORMAT, data)
+    result = dict(zip(["uptime_us", "payload_bytes", "frames", "overruns",
+                       "parse_errors", "milliamps", "limited_frames",
+                       "power_limit"], values[:8]))
+    commands = values[8:8 + MAX_COMMANDS]
+    result["commands"] = {COMMAND_NAMES.get(i, str(i)): count
+                          for i, count in enumerate(commands) if count}
+    rest = values[8 + MAX_COMMANDS:]
+    for index, name in enumerate(["parse", "render", "flush"]):
+        result[name] = parse_time_stats(rest[index * 5:(index + 1) * 5])
+    result.update(zip(["received_frames", "framing_errors", "crc_errors",
+                       "overflows", "first_frame_us", "snapshots"],
+                      rest[15:]))
+    return result
+
+
+def request_stats(port):
+    port.write(command(GET_STATS, b"\x00"))
+    deadline = time.monotonic() + 2
+    while time.monotonic() < deadline:
+        line = port.readline().decode("ascii", errors="replace").strip()
+        if line.startswith("STATS "):
+            return parse_stats(bytes.fromhex(line[len("STATS "):]))
+    raise TimeoutError("no reply to GetStats")
+
+
+def rates(previous, current):
+    elapsed = (current["uptime_us"] - previous["uptime_us"]) / 1e6
+    if elapsed <= 0:
+        return 0, 0
+    frames = current["frames"] - previous["frames"]
+    payload = current["payload_bytes"] - previous["payload_bytes"]
+    return frames / elapsed, payload / elapsed
+
+
+def describe(stats, fps, bytes_per_second):
+    def timing(name):
+        t = stats[name]
+        return "%s %d/%.0f/%dus" % (name, t["min"], t["avg"], t["max"])
+
+    return ("%.1f fps, %.0f B/s, %s, %s, %s, overruns %d, errors %d "
+            "(framing %d, crc %d, overflows %d), "
+            "%d mA (limit %d/256, %d frames limited), "
+            "first frame after %.1f ms, %d snapshots" % (
+                fps, bytes_per_second, timing("parse"), timing("render"),
+                timing("flush"), stats["overruns"], stats["parse_errors"],
+                stats["framing_errors"], stats["crc_errors"],
+                stats["overflows"], stats["milliamps"], stats["power_limit"],
+                stats["limited_frames"], stats["first_frame_us"] / 1000,
+                stats["snapshots"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--period", type=float, default=1.0)
+    parser.add_argument("--plot", action="store_true")
+    args = parser.parse_args()
+
+    import serial
+    port = serial.Serial(args.port, args.baud, timeout=0.5)
+    port.write(command(HELO, b"HELO"))
+
+    if args.plot:
+        import matplotlib.pyplot as plt
+        plt.ion()
+        figure, axes = plt.subplots(3, 1, sharex=True)
+        history = {"t": [], "fps": [], "bps": [], "render": [], "parse": []}
+
+    previous = request_stats(port)
+    while True:
+        time.sleep(args.period)
+        current = request_stats(port)
+        fps, bytes_per_second = rates(previous, current)
+        print(describe(current, fps, bytes_per_second))
+        sys.stdout.flush()
+
+        if args.plot:
+            history["t"].append(current["uptime_us"] / 1e6)
+            history["fps"].append(fps)
+            history["bps"].append(bytes_per_second)
+            history["render"].append(current["render"]["last"])
+            history["parse"].append(current["parse"]["last"])
+            for axis in axes:
+                axis.clear()
+            axes[0].plot(history["t"], history["fps"])
+            axes[0].set_ylabel("fps")
+            axes[1].plot(history["t"], history["bps"])
+            axes[1].set_ylabel("payload B/s")
+            axes[2].plot(history["t"], history["render"], label="render")
+            axes[2].plot(history["t"], history["parse"], label="parse")
+            axes[2].set_ylabel("us")
+            axes[2].legend()
+            plt.pause(0.01)
+
+        previous = current
+
+
+if __name__ == "__main__":
+    main()
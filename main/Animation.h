@@ -0,0 +1,333 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_partition.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "ArrayRef.h"
+#include "LED.h"
+
+/// Animations stored in flash and played back without going through the LEDs.
+///
+/// An animation is a Header followed by Frames frames, each one made of Ports
+/// strips of LEDsPerStrip LEDs in physical order, stored as described by
+/// Format (see ExternalFormat). It lives in the "animation" data partition,
+/// which is memory mapped, so that frames can be handed to the output as they
+/// are. All the fields are little endian.
+namespace Animation {
+
+struct Header {
+  static constexpr std::array<char, 4> ExpectedMagic = {'L', 'A', 'N', 'I'};
+  static constexpr uint16_t CurrentVersion = 1;
+
+  std::array<char, 4> Magic = ExpectedMagic;
+  uint16_t Version = CurrentVersion;
+  ExternalFormat Format = ExternalFormat::Encoded;
+  uint8_t Ports = 0;
+  uint32_t LEDsPerStrip = 0;
+  uint32_t Frames = 0;
+  /// Number of device frames each frame is shown for
+  uint16_t FrameRepeat = 1;
+  uint16_t Reserved = 0;
+
+  size_t ledSize() const {
+    return Format == ExternalFormat::RGB ? sizeof(RGBColor)
+                                         : sizeof(WS2812::EncodedLED);
+  }
+
+  size_t frameSize() const { return ledSize() * LEDsPerStrip * Ports; }
+
+  /// Size of the whole animation, header included
+  size_t size() const { return sizeof(Header) + frameSize() * Frames; }
+
+  bool verify(size_t Capacity) const {
+    if (Magic != ExpectedMagic or Version != CurrentVersion)
+      return false;
+    if (Format != ExternalFormat::RGB and Format != ExternalFormat::Encoded)
+      return false;
+    if (Frames == 0 or FrameRepeat == 0)
+      return false;
+    // Check the size in 64 bits, the fields come from outside
+    uint64_t Total = uint64_t(ledSize()) * LEDsPerStrip * Ports * Frames;
+    return Total + sizeof(Header) <= Capacity;
+  }
+};
+
+static_assert(sizeof(Header) == 20);
+static_assert(sizeof(RGBColor) == 3 and alignof(RGBColor) == 1);
+
+#ifndef ESP_PLATFORM
+/// On the host, the partition is emulated by this file, if set, or by
+/// anonymous memory otherwise
+inline const char *HostPartitionFile = nullptr;
+inline constexpr size_t HostPartitionSize = 960 * 1024;
+#endif
+
+/// The flash partition holding the animation, mapped in memory. As on flash,
+/// writing can only clear bits, erasing sets them back.
+class Storage {
+public:
+  static constexpr size_t SectorSize = 4096;
+
+private:
+  const uint8_t *Mapped = nullptr;
+  size_t Capacity = 0;
+
+#ifdef ESP_PLATFORM
+  const esp_partition_t *Partition = nullptr;
+  esp_partition_mmap_handle_t Handle;
+#else
+  uint8_t *Writable = nullptr;
+#endif
+
+public:
+  /// Map the partition, returns false if it's not available
+  bool open() {
+    if (Mapped != nullptr)
+      return true;
+
+#ifdef ESP_PLATFORM
+    Partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "animation");
+    if (Partition == nullptr)
+      return false;
+
+    const void *Pointer = nullptr;
+    if (esp_partition_mmap(Partition, 0, Partition->size,
+                           ESP_PARTITION_MMAP_DATA, &Pointer,
+                           &Handle) != ESP_OK)
+      return false;
+    Mapped = static_cast<const uint8_t *>(Pointer);
+    Capacity = Partition->size;
+#else
+    size_t Size = HostPartitionSize;
+    void *Pointer = MAP_FAILED;
+    if (HostPartitionFile == nullptr) {
+      Pointer = mmap(nullptr, Size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (Pointer != MAP_FAILED)
+        memset(Pointer, 0xFF, Size);
+    } else {
+      int File = ::open(HostPartitionFile, O_RDWR | O_CREAT, 0644);
+      if (File < 0)
+        return false;
+
+      // A new or short file is extended as if it had just been erased
+      off_t Existing = lseek(File, 0, SEEK_END);
+      if (Existing >= 0 and size_t(Existing) < Size) {
+        std::array<uint8_t, SectorSize> Erased;
+        Erased.fill(0xFF);
+        for (size_t Offset = Existing; Offset < Size; Offset += SectorSize)
+          if (pwrite(File, Erased.data(), std::min(SectorSize, Size - Offset),
+                     Offset) < 0)
+            break;
+      }
+
+      Pointer = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, File,
+                     0);
+      close(File);
+    }
+
+    if (Pointer == MAP_FAILED)
+      return false;
+    Writable = static_cast<uint8_t *>(Pointer);
+    Mapped = Writable;
+    Capacity = Size;
+#endif
+
+    return true;
+  }
+
+  const uint8_t *data() const { return Mapped; }
+
+  size_t capacity() const { return Capacity; }
+
+  /// Erase the sectors in [Offset, Offset + Size), which must be aligned
+  bool erase(size_t Offset, size_t Size) {
+    assert(Offset % SectorSize == 0 and Size % SectorSize == 0);
+    if (Offset + Size > Capacity)
+      return false;
+#ifdef ESP_PLATFORM
+    return esp_partition_erase_range(Partition, Offset, Size) == ESP_OK;
+#else
+    memset(Writable + Offset, 0xFF, Size);
+    return true;
+#endif
+  }
+
+  bool write(size_t Offset, const void *Data, size_t Size) {
+    if (Offset + Size > Capacity)
+      return false;
+#ifdef ESP_PLATFORM
+    return esp_partition_write(Partition, Offset, Data, Size) == ESP_OK;
+#else
+    const auto *Bytes = static_cast<const uint8_t *>(Data);
+    for (size_t I = 0; I < Size; ++I)
+      Writable[Offset + I] &= Bytes[I];
+    return true;
+#endif
+  }
+};
+
+/// Writes an animation received in pieces into the storage, erasing sectors
+/// as it goes. The magic number is written last, so that an interrupted
+/// upload leaves no valid animation behind.
+class Uploader {
+private:
+  Storage &Target;
+  Header Pending;
+  size_t Offset = 0;
+  /// Everything below this has been erased as part of this upload
+  size_t ErasedUpTo = 0;
+  bool Failed = false;
+
+public:
+  Uploader(Storage &Target) : Target(Target) {}
+
+public:
+  /// Start over with a new animation
+  void reset() {
+    Offset = 0;
+    ErasedUpTo = 0;
+    Failed = false;
+  }
+
+  bool complete() const {
+    return not Failed and Offset >= sizeof(Header) and
+           Offset == Pending.size();
+  }
+
+  /// Append Data to the animation being uploaded
+  bool append(ArrayRef<const uint8_t> Data) {
+    if (Failed)
+      return false;
+
+    // Collect the header in memory, it's needed to know where to stop
+    size_t Consumed = 0;
+    if (Offset < sizeof(Header)) {
+      Consumed = std::min(Data.Size, sizeof(Header) - Offset);
+      memcpy(reinterpret_cast<uint8_t *>(&Pending) + Offset, Data.Data,
+             Consumed);
+      Offset += Consumed;
+      if (Offset < sizeof(Header))
+        return true;
+
+      constexpr size_t MagicSize = sizeof(Header::Magic);
+      if (not Pending.verify(Target.capacity()) or
+          not prepare(0, sizeof(Header)) or
+          not Target.write(MagicSize,
+                           reinterpret_cast<const uint8_t *>(&Pending) +
+                               MagicSize,
+                           sizeof(Header) - MagicSize))
+        return fail();
+    }
+
+    size_t Size = Data.Size - Consumed;
+    if (Offset + Size > Pending.size())
+      return fail();
+    if (not prepare(Offset, Size) or
+        not Target.write(Offset, Data.Data + Consumed, Size))
+      return fail();
+    Offset += Size;
+
+    if (Offset == Pending.size() and
+        not Target.write(0, &Pending.Magic, sizeof(Pending.Magic)))
+      return fail();
+
+    return true;
+  }
+
+private:
+  /// Erase whatever is needed to write [Start, Start + Size)
+  bool prepare(size_t Start, size_t Size) {
+    size_t End = Start + Size;
+    if (End <= ErasedUpTo)
+      return true;
+
+    size_t EraseEnd =
+        (End + Storage::SectorSize - 1) / Storage::SectorSize *
+        Storage::SectorSize;
+    EraseEnd = std::min(EraseEnd, Target.capacity());
+    if (not Target.erase(ErasedUpTo, EraseEnd - ErasedUpTo))
+      return false;
+    ErasedUpTo = EraseEnd;
+    return true;
+  }
+
+  bool fail() {
+    Failed = true;
+    return false;
+  }
+};
+
+/// Plays the animation in the storage, one device frame at a time
+class Player {
+private:
+  const Header *Animation = nullptr;
+  const uint8_t *FrameData = nullptr;
+  uint32_t Frame = 0;
+  uint16_t Repeat = 0;
+  bool Loop = false;
+
+public:
+  /// Start playing the animation in Source, provided it's valid and matches
+  /// the geometry of the LEDs
+  bool start(const Storage &Source, size_t LEDsPerStrip, size_t Ports,
+             bool ShouldLoop) {
+    stop();
+    if (Source.data() == nullptr)
+      return false;
+
+    const auto *Candidate = reinterpret_cast<const Header *>(Source.data());
+    if (not Candidate->verify(Source.capacity()) or
+        Candidate->LEDsPerStrip != LEDsPerStrip or Candidate->Ports != Ports)
+      return false;
+
+    Animation = Candidate;
+    FrameData = Source.data() + sizeof(Header);
+    Loop = ShouldLoop;
+    return true;
+  }
+
+  void stop() {
+    Animation = nullptr;
+    Frame = 0;
+    Repeat = 0;
+  }
+
+  bool playing() const { return Animation != nullptr; }
+
+  ExternalFormat format() const { return Animation->Format; }
+
+  /// The frame to show now
+  const uint8_t *frame() const {
+    return FrameData + size_t(Frame) * Animation->frameSize();
+  }
+
+  /// Move on by one device frame, returns false once the animation is over
+  bool advance() {
+    if (++Repeat < Animation->FrameRepeat)
+      return true;
+    Repeat = 0;
+
+    if (++Frame < Animation->Frames)
+      return true;
+    Frame = 0;
+
+    if (Loop)
+      return true;
+    stop();
+    return false;
+  }
+};
+
+} // namespace Animation
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <stdint.h>
+#include <stdlib.h>
+
+/// Fixed-size bitset exposing its storage, so that users can scan it a word at
+/// a time
+template <size_t Size> struct BitSet {
+  using word_t = uint32_t;
+  static constexpr size_t WordBits = sizeof(word_t) * 8;
+  static constexpr size_t WordCount = (Size + WordBits - 1) / WordBits;
+
+  std::array<word_t, WordCount> Words{};
+
+  bool test(size_t Index) const {
+    return ((Words[Index / WordBits] >> (Index % WordBits)) & 1) != 0;
+  }
+
+  void set(size_t Index) {
+    Words[Index / WordBits] |= word_t(1) << (Index % WordBits);
+  }
+
+  void clear(size_t Index) {
+    Words[Index / WordBits] &= ~(word_t(1) << (Index % WordBits));
+  }
+
+  void setAll() { Words.fill(~word_t(0)); }
+
+  /// Mask selecting the bits of the word starting at Start that are below
+  /// Limit
+  static word_t mask(size_t Start, size_t Limit) {
+    size_t Count = Limit - Start;
+    return Count < WordBits ? (word_t(1) << Count) - 1 : ~word_t(0);
+  }
+};
@@ -58,6 +58,39 @@ RGBColor HSVColor::toRGBColor() const {
   return Result;
 }
 
+RGB16Color HSVColor::toRGB16Color() const {
+  // Same as toRGBColor, keeping 8 more bits and with exact divisions
+  uint32_t v = Value << 8;
+  if (Saturation == 0)
+    return RGB16Color(v, v, v);
+
+  unsigned h = Hue;
+  unsigned s = Saturation;
+
+  uint8_t region = h / 43;
+  unsigned remainder = (h - (region * 43)) * 6;
+
+  // v * 255 * 255 fits in 32 bits
+  uint16_t p = v * (255 - s) / 255;
+  uint16_t q = v * (255 * 255 - s * remainder) / (255 * 255);
+  uint16_t t = v * (255 * 255 - s * (255 - remainder)) / (255 * 255);
+
+  switch (region) {
+  case 0:
+    return RGB16Color(v, t, p);
+  case 1:
+    return RGB16Color(q, v, p);
+  case 2:
+    return RGB16Color(p, v, t);
+  case 3:
+    return RGB16Color(p, q, v);
+  case 4:
+    return RGB16Color(t, p, v);
+  default:
+    return RGB16Color(v, p, q);
+  }
+}
+
 HSVColor RGBColor::toHSVColor() const {
   HSVColor Result;
 
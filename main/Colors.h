@@ -3,6 +3,18 @@
 #include <stdint.h>
 
 class RGBColor;
+class RGB16Color;
+
+/// Move From towards To by Factor / 2^32 of the distance, rounding to nearest
+/// and ties away from From. Factor is precise enough that, when it is rounded
+/// up from a fraction of frames, e.g., N/M of a transition over M frames, the
+/// result is the exact one, rounded, for any realistic M.
+template <typename T>
+inline T interpolatedChannel(T From, T To, uint64_t Factor) {
+  uint64_t Distance = From < To ? To - From : From - To;
+  auto Step = T((Distance * Factor + (uint64_t(1) << 31)) >> 32);
+  return From < To ? From + Step : From - Step;
+}
 
 class HSVColor {
 public:
@@ -16,7 +28,13 @@ public:
       : Hue(Hue), Saturation(Saturation), Value(Value) {}
 
 public:
+  bool operator==(const HSVColor &Other) const = default;
+
   RGBColor toRGBColor() const;
+
+  /// Like toRGBColor, but keeping the precision lost by rounding to 8 bits,
+  /// which matters most for dim colors
+  RGB16Color toRGB16Color() const;
 };
 
 class RGBColor {
@@ -31,5 +49,89 @@ public:
       : Red(Red), Green(Green), Blue(Blue) {}
 
 public:
+  bool operator==(const RGBColor &Other) const = default;
+
   HSVColor toHSVColor() const;
+
+  unsigned sum() const { return Red + Green + Blue; }
+
+  /// Scale all the channels by Factor / 256, rounding to nearest
+  RGBColor scaled(uint16_t Factor) const {
+    return RGBColor((Red * Factor + 128) >> 8, (Green * Factor + 128) >> 8,
+                    (Blue * Factor + 128) >> 8);
+  }
+
+  /// Move towards Target by Factor / 65536 of the distance, rounding to
+  /// nearest. A Factor of 65536 yields Target.
+  RGBColor interpolated(const RGBColor &Target, uint32_t Factor) const {
+    auto Step = [Factor](uint8_t From, uint8_t To) {
+      int32_t Delta = int32_t(To) - From;
+      return uint8_t(From + ((Delta * int32_t(Factor) + 32768) >> 16));
+    };
+    return RGBColor(Step(Red, Target.Red), Step(Green, Target.Green),
+                    Step(Blue, Target.Blue));
+  }
+
+  /// Like interpolated, but with Factor out of 2^32, see interpolatedChannel
+  RGBColor interpolatedPrecisely(const RGBColor &Target,
+                                 uint64_t Factor) const {
+    return RGBColor(interpolatedChannel(Red, Target.Red, Factor),
+                    interpolatedChannel(Green, Target.Green, Factor),
+                    interpolatedChannel(Blue, Target.Blue, Factor));
+  }
+};
+
+/// RGB with 16 bits per channel, in 1/256 of the steps of RGBColor: 255 << 8
+/// is full brightness and the low byte is the fraction that does not fit in
+/// 8 bits
+class RGB16Color {
+public:
+  uint16_t Red;
+  uint16_t Green;
+  uint16_t Blue;
+
+public:
+  RGB16Color() : Red(0), Green(0), Blue(0) {}
+  RGB16Color(uint16_t Red, uint16_t Green, uint16_t Blue)
+      : Red(Red), Green(Green), Blue(Blue) {}
+  explicit RGB16Color(const RGBColor &Color)
+      : Red(Color.Red << 8), Green(Color.Green << 8), Blue(Color.Blue << 8) {}
+
+public:
+  bool operator==(const RGB16Color &Other) const = default;
+
+  /// Round to the nearest 8-bit color
+  RGBColor toRGBColor() const {
+    auto Round = [](uint16_t Channel) {
+      return uint8_t(Channel >= 0xFF80 ? 0xFF : (Channel + 0x80) >> 8);
+    };
+    return RGBColor(Round(Red), Round(Green), Round(Blue));
+  }
+
+  /// Scale all the channels by Factor / 256, rounding to nearest
+  RGB16Color scaled(uint16_t Factor) const {
+    auto Scale = [Factor](uint16_t Channel) {
+      return uint16_t((uint32_t(Channel) * Factor + 128) >> 8);
+    };
+    return RGB16Color(Scale(Red), Scale(Green), Scale(Blue));
+  }
+
+  /// Move towards Target by Factor / 65536 of the distance, rounding to
+  /// nearest. A Factor of 65536 yields Target.
+  RGB16Color interpolated(const RGB16Color &Target, uint32_t Factor) const {
+    auto Step = [Factor](uint16_t From, uint16_t To) {
+      int64_t Delta = int64_t(To) - From;
+      return uint16_t(From + ((Delta * Factor + 32768) >> 16));
+    };
+    return RGB16Color(Step(Red, Target.Red), Step(Green, Target.Green),
+                      Step(Blue, Target.Blue));
+  }
+
+  /// Like interpolated, but with Factor out of 2^32, see interpolatedChannel
+  RGB16Color interpolatedPrecisely(const RGB16Color &Target,
+                                   uint64_t Factor) const {
+    return RGB16Color(interpolatedChannel(Red, Target.Red, Factor),
+                      interpolatedChannel(Green, Target.Green, Factor),
+                      interpolatedChannel(Blue, Target.Blue, Factor));
+  }
 };
@@ -1,40 +1,73 @@
+#include <algorithm>
+#include <sys/select.h>
+#include <utility>
+
 #include "Command.h"
 
 namespace Command {
 
-struct cursor_t {
-  uint32_t Column;
-  uint32_t Line;
-
-  void operator++() { ++Column; }
-
-  cursor_t operator+(size_t Columns) const {
-    cursor_t Result = *this;
-    Result.Column += Columns;
-    assert(Result.verify());
-    return Result;
-  }
-
-  bool verify() const {
-    // TODO: fix
-    return Column < 80 and Line < 22;
-  }
-};
-
-enum class BufferType { FixedSize, Array };
+enum class BufferType { FixedSize, Array, Bytes };
 
 class Context {
 public:
+  static constexpr size_t MaxPendingProbes = 8;
+
   bool SaidHello = false;
   cursor_t WriteCursor;
 
-  Context() : WriteCursor({0, 0}) {}
+  /// Layer written by UpdateRange
+  size_t Layer = 0;
+
+  /// Whether this controller is a tile of a larger canvas, see TileMessage
+  bool Tiled = false;
+  cursor_t Origin{0, 0};
+
+  /// Whether frames are shown only on Present, and if one has been received
+  /// since the last frame
+  bool Synchronized = false;
+  bool Presented = false;
+
+  /// When the header of the command being parsed has been received
+  uint64_t HeaderMicros = 0;
+
+  /// Probes waiting for the next frame
+  std::array<ProbeReply, MaxPendingProbes> PendingProbes;
+  size_t PendingProbesCount = 0;
+
+  Animation::Storage Flash;
+  Animation::Uploader Upload;
+  Animation::Player Player;
+
+  Context() : WriteCursor({0, 0}), Upload(Flash) {}
+
+  void stopAnimation() {
+    Player.stop();
+    LEDs.showLEDs();
+  }
+
+  /// Check that Elements LEDs can be written starting from Start. On a tile,
+  /// runs can extend outside of it and only the LEDs within it are written.
+  bool verifyRun(cursor_t Start, size_t Elements) const {
+    if (Tiled)
+      return Start.Column + uint64_t(Elements) <= UINT32_MAX;
+    return Elements == 0 or (Start + (Elements - 1)).verify();
+  }
+
+  /// Convert a cursor to the coordinates of the LEDs, returns false if it's
+  /// outside of this tile
+  bool toLocal(cursor_t &Cursor) const {
+    if (Cursor.Column < Origin.Column or Cursor.Line < Origin.Line)
+      return false;
+    Cursor.Column -= Origin.Column;
+    Cursor.Line -= Origin.Line;
+    return Cursor.verify();
+  }
 };
 
 class Helo {
 public:
   static constexpr const char *Name = "Helo";
-  static constexpr char ID = 1;
+  static constexpr identifier_t ID = ids::Helo;
   static constexpr BufferType Type = BufferType::FixedSize;
   using FixedType = std::array<uint8_t, 4>;
 
@@ -44,17 +77,19 @@ private:
 public:
   Helo(Context &C) : C(C) {}
 
-  void parse(const FixedType *Object) {
+  bool parse(const FixedType *Object) {
     static FixedType Reference = {'H', 'E', 'L', 'O'};
-    assert(0 == memcmp(Object, &Reference, sizeof(FixedType)));
+    if (0 != memcmp(Object, &Reference, sizeof(FixedType)))
+      return false;
     C.SaidHello = true;
+    return true;
   }
 };
 
 class UpdateRange {
 public:
   static constexpr const char *Name = "UpdateRange";
-  static constexpr char ID = 2;
+  static constexpr identifier_t ID = ids::UpdateRange;
   static constexpr BufferType Type = BufferType::Array;
   using ArrayType = LEDDescriptor;
 
@@ -63,28 +98,83 @@ private:
   cursor_t LocalWriteCursor;
 
 public:
-  UpdateRange(Context &C) : C(C), LocalWriteCursor(C.WriteCursor) {
-    assert(LocalWriteCursor.verify());
+  UpdateRange(Context &C) : C(C), LocalWriteCursor(C.WriteCursor) {}
+
+public:
+  bool preparse(size_t Elements) {
+    return C.SaidHello and C.verifyRun(LocalWriteCursor, Elements);
   }
 
+  bool parseOne(const LEDDescriptor *Object) {
+    if (not Object->verify())
+      return false;
+    cursor_t Local = LocalWriteCursor;
+    if (C.toLocal(Local))
+      LEDs.setInLayer(C.Layer, Local.Column, Local.Line, Object->Color,
+                      Object->Blink);
+    ++LocalWriteCursor;
+    return true;
+  }
+};
+
+/// Like UpdateRange, but stages the colors as targets of the next Tween.
+/// Transitions only apply to the LEDs, regardless of the selected layer.
+class UpdateTarget {
 public:
-  void preparse(size_t Elements) {
-    assert(C.SaidHello);
-    assert((LocalWriteCursor + (Elements - 1)).verify());
+  static constexpr const char *Name = "UpdateTarget";
+  static constexpr identifier_t ID = ids::UpdateTarget;
+  static constexpr BufferType Type = BufferType::Array;
+  using ArrayType = LEDDescriptor;
+
+private:
+  Context &C;
+  cursor_t LocalWriteCursor;
+
+public:
+  UpdateTarget(Context &C) : C(C), LocalWriteCursor(C.WriteCursor) {}
+
+public:
+  bool preparse(size_t Elements) {
+    return C.SaidHello and C.verifyRun(LocalWriteCursor, Elements);
   }
 
-  void parseOne(const LEDDescriptor *Object) {
-    assert(Object->verify());
-    LEDs.set(LocalWriteCursor.Column, LocalWriteCursor.Line,
-             Object->Color.toRGBColor(), Object->Blink);
+  bool parseOne(const LEDDescriptor *Object) {
+    if (not Object->verify())
+      return false;
+    cursor_t Local = LocalWriteCursor;
+    if (C.toLocal(Local))
+      LEDs.setTarget(Local.Column, Local.Line, Object->Color, Object->Blink);
     ++LocalWriteCursor;
+    return true;
+  }
+};
+
+class Tween {
+public:
+  static constexpr const char *Name = "Tween";
+  static constexpr identifier_t ID = ids::Tween;
+  static constexpr BufferType Type = BufferType::FixedSize;
+  using FixedType = TweenMessage;
+
+private:
+  Context &C;
+
+public:
+  Tween(Context &C) : C(C) {}
+
+  bool parse(const TweenMessage *Object) {
+    if (not C.SaidHello)
+      return false;
+    log("Tween(Frames: %ld)\n", Object->Frames);
+    LEDs.startTween(Object->Frames);
+    return true;
   }
 };
 
 class MoveCursor {
 public:
   static constexpr const char *Name = "MoveCursor";
-  static constexpr char ID = 3;
+  static constexpr identifier_t ID = ids::MoveCursor;
   static constexpr BufferType Type = BufferType::FixedSize;
   using FixedType = cursor_t;
 
@@ -94,24 +184,22 @@ private:
 public:
   MoveCursor(Context &C) : C(C) {}
 
-  void parse(const cursor_t *Object) {
-    assert(C.SaidHello);
+  bool parse(const cursor_t *Object) {
+    if (not C.SaidHello)
+      return false;
     log("MoveCursor(Column: %ld, Line: %ld)\n", Object->Column, Object->Line);
-    assert(Object->verify());
+    // On a tile, the cursor can be anywhere in the canvas
+    if (not C.Tiled and not Object->verify())
+      return false;
     C.WriteCursor = *Object;
+    return true;
   }
 };
 
-struct ConfigureMessage {
-  uint8_t Debug = 0;
-
-  bool verify() const { return Debug < 2; }
-};
-
 class Configure {
 public:
   static constexpr const char *Name = "Configure";
-  static constexpr char ID = 4;
+  static constexpr identifier_t ID = ids::Configure;
   static constexpr BufferType Type = BufferType::FixedSize;
   using FixedType = ConfigureMessage;
 
@@ -121,119 +209,621 @@ private:
 public:
   Configure(Context &C) : C(C) {}
 
-  void parse(const ConfigureMessage *Object) {
-    assert(C.SaidHello);
+  bool parse(const ConfigureMessage *Object) {
+    if (not C.SaidHello)
+      return false;
     log("Configure(Debug: %ld)\n", Object->Debug);
-    assert(Object->verify());
+    if (not Object->verify())
+      return false;
 
     EnableDebug = Object->Debug;
+    return true;
   }
 };
 
-Context C;
-using identifier_t = uint8_t;
-using length_t = uint32_t;
+class SetOutput {
+public:
+  static constexpr const char *Name = "SetOutput";
+  static constexpr identifier_t ID = ids::SetOutput;
+  static constexpr BufferType Type = BufferType::FixedSize;
+  using FixedType = OutputMessage;
 
-static constexpr size_t MaxReadSize = sizeof(cursor_t);
+private:
+  Context &C;
+
+public:
+  SetOutput(Context &C) : C(C) {}
+
+  bool parse(const OutputMessage *Object) {
+    if (not C.SaidHello)
+      return false;
+    log("SetOutput(Brightness: %d, Gamma: %d %d %d)\n", Object->Brightness,
+        Object->Gamma[0], Object->Gamma[1], Object->Gamma[2]);
+    if (not Object->verify())
+      return false;
+    LEDs.Stage.configure(Object->Brightness, Object->Gamma);
+    return true;
+  }
+};
+
+class SetPowerBudget {
+public:
+  static constexpr const char *Name = "SetPowerBudget";
+  static constexpr identifier_t ID = ids::SetPowerBudget;
+  static constexpr BufferType Type = BufferType::FixedSize;
+  using FixedType = PowerBudgetMessage;
+
+private:
+  Context &C;
+
+public:
+  SetPowerBudget(Context &C) : C(C) {}
+
+  bool parse(const PowerBudgetMessage *Object) {
+    if (not C.SaidHello)
+      return false;
+    log("SetPowerBudget(Milliamps: %ld)\n", Object->Milliamps);
+    LEDs.MilliampBudget = Object->Milliamps;
+    return true;
+  }
+};
+
+class SelectLayer {
+public:
+  static constexpr const char *Name = "SelectLayer";
+  static constexpr identifier_t ID = ids::SelectLayer;
+  static constexpr BufferType Type = BufferType::FixedSize;
+  using FixedType = SelectLayerMessage;
+
+private:
+  Context &C;
+
+public:
+  SelectLayer(Context &C) : C(C) {}
+
+  bool parse(const SelectLayerMessage *Object) {
+    if (not C.SaidHello)
+      return false;
+    log("SelectLayer(Layer: %d)\n", Object->Layer);
+    if (Object->Layer > Overlays)
+      return false;
+    C.Layer = Object->Layer;
+    return true;
+  }
+};
+
+class ConfigureLayer {
+public:
+  static constexpr const char *Name = "ConfigureLayer";
+  static constexpr identifier_t ID = ids::ConfigureLayer;
+  static constexpr BufferType Type = BufferType::FixedSize;
+  using FixedType = ConfigureLayerMessage;
+
+private:
+  Context &C;
+
+public:
+  ConfigureLayer(Context &C) : C(C) {}
+
+  bool parse(const ConfigureLayerMessage *Object) {
+    if (not C.SaidHello)
+      return false;
+    log("ConfigureLayer(Layer: %d, Opacity: %d, Flags: %d)\n", Object->Layer,
+        Object->Opacity, Object->Flags);
+    if (not Object->verify() or Object->Layer == 0 or
+        Object->Layer > Overlays)
+      return false;
+
+    LayerSettings Settings;
+    Settings.Opacity = Object->Opacity;
+    Settings.Keyed = Object->Flags & ConfigureLayerMessage::Keyed;
+    Settings.Key = Object->Key;
+    LEDs.configureLayer(Object->Layer, Settings,
+                        Object->Flags & ConfigureLayerMessage::Clear);
+    return true;
+  }
+};
+
+class SetTile {
+public:
+  static constexpr const char *Name = "SetTile";
+  static constexpr identifier_t ID = ids::SetTile;
+  static constexpr BufferType Type = BufferType::FixedSize;
+  using FixedType = TileMessage;
+
+private:
+  Context &C;
+
+public:
+  SetTile(Context &C) : C(C) {}
+
+  bool parse(const TileMessage *Object) {
+    if (not C.SaidHello)
+      return false;
+    log("SetTile(Column: %ld, Line: %ld, Synchronized: %d)\n",
+        Object->Origin.Column, Object->Origin.Line, Object->Synchronized);
+    if (not Object->verify())
+      return false;
+    C.Tiled = true;
+    C.Origin = Object->Origin;
+    C.Synchronized = Object->Synchronized;
+    C.Presented = false;
+    return true;
+  }
+};
+
+/// Show what has been received so far on the next frame, for tiles in
+/// synchronized mode. The protocol frames following it are only parsed after
+/// that frame, so that it shows exactly what came before. It's meant to be
+/// broadcast to all the tiles at the frame rate.
+class Present {
+public:
+  static constexpr const char *Name = "Present";
+  static constexpr identifier_t ID = ids::Present;
+  static constexpr BufferType Type = BufferType::Bytes;
+
+private:
+  Context &C;
+
+public:
+  Present(Context &C) : C(C) {}
+
+  bool parse(ArrayRef<const uint8_t> Payload) {
+    if (not C.SaidHello or Payload.Size != 0)
+      return false;
+    C.Presented = true;
+    return true;
+  }
+};
+
+/// Write a piece of an animation to flash, in order. An empty payload starts
+/// a new upload. Playback stops, since the animation is being overwritten.
+class UploadAnimation {
+public:
+  static constexpr const char *Name = "UploadAnimation";
+  static constexpr identifier_t ID = ids::UploadAnimation;
+  static constexpr BufferType Type = BufferType::Bytes;
+
+private:
+  Context &C;
+
+public:
+  UploadAnimation(Context &C) : C(C) {}
 
-ArrayRef<uint8_t> read(size_t Size);
+  bool parse(ArrayRef<const uint8_t> Payload) {
+    if (not C.SaidHello or not C.Flash.open())
+      return false;
 
-template <typename T> T *read() {
-  return reinterpret_cast<T *>(read(sizeof(T)).Data);
+    C.stopAnimation();
+    if (Payload.Size == 0) {
+      C.Upload.reset();
+      return true;
+    }
+
+    return C.Upload.append(Payload);
+  }
+};
+
+class PlayAnimation {
+public:
+  static constexpr const char *Name = "PlayAnimation";
+  static constexpr identifier_t ID = ids::PlayAnimation;
+  static constexpr BufferType Type = BufferType::FixedSize;
+  using FixedType = PlayAnimationMessage;
+
+private:
+  Context &C;
+
+public:
+  PlayAnimation(Context &C) : C(C) {}
+
+  bool parse(const PlayAnimationMessage *Object) {
+    if (not C.SaidHello)
+      return false;
+    log("PlayAnimation(Mode: %d)\n", Object->Mode);
+    if (not Object->verify())
+      return false;
+
+    C.stopAnimation();
+    if (Object->Mode == PlayAnimationMessage::Stop)
+      return true;
+
+    bool Loop = Object->Mode == PlayAnimationMessage::Loop;
+    if (not C.Flash.open() or
+        not C.Player.start(C.Flash, LEDs.size(), MaxPorts, Loop))
+      return false;
+    LEDs.showExternal(C.Player.format(), C.Player.frame());
+    return true;
+  }
+};
+
+class SetBootFrame {
+public:
+  static constexpr const char *Name = "SetBootFrame";
+  static constexpr identifier_t ID = ids::SetBootFrame;
+  static constexpr BufferType Type = BufferType::FixedSize;
+  using FixedType = BootFrameMessage;
+
+private:
+  Context &C;
+
+public:
+  SetBootFrame(Context &C) : C(C) {}
+
+  bool parse(const BootFrameMessage *Object) {
+    if (not C.SaidHello)
+      return false;
+    log("SetBootFrame(Mode: %d)\n", Object->Mode);
+    if (not Object->verify())
+      return false;
+    BootFrame.setMode(Snapshot::Modes(Object->Mode), LEDs);
+    return true;
+  }
+};
+
+/// Send a binary reply to the host as a line made of Tag followed by the
+/// hexadecimal dump of Data, which keeps it safe from line ending translation
+void reply(const char *Tag, const void *Data, size_t Size) {
+  const auto *Bytes = static_cast<const uint8_t *>(Data);
+  printf("%s ", Tag);
+  for (size_t I = 0; I < Size; ++I)
+    printf("%02x", Bytes[I]);
+  putchar('\n');
 }
 
-template <typename T> void parseFixedSize(length_t Length) {
-  Trace TT(event_ids::ParseFixedSize, Length);
-  assert(sizeof(typename T::FixedType) == Length);
+class GetStats {
+public:
+  static constexpr const char *Name = "GetStats";
+  static constexpr identifier_t ID = ids::GetStats;
+  static constexpr BufferType Type = BufferType::FixedSize;
+  using FixedType = GetStatsMessage;
+
+private:
+  Context &C;
+
+public:
+  GetStats(Context &C) : C(C) {}
+
+  bool parse(const GetStatsMessage *Object) {
+    if (not C.SaidHello)
+      return false;
+    log("GetStats(Reset: %d)\n", Object->Reset);
+    if (not Object->verify())
+      return false;
+
+    Stats Snapshot = Statistics;
+    Snapshot.UptimeMicros = micros();
+    Snapshot.EstimatedMilliamps = LEDs.Power.EstimatedMilliamps;
+    Snapshot.LimitedFrames = LEDs.Power.LimitedFrames;
+    Snapshot.PowerLimit = LEDs.Power.Limit;
+    reply("STATS", &Snapshot, sizeof(Snapshot));
+
+    if (Object->Reset) {
+      // Happens once per boot, keep it
+      uint32_t FirstFrameMicros = Statistics.FirstFrameMicros;
+      Statistics = {};
+      Statistics.FirstFrameMicros = FirstFrameMicros;
+    }
+    return true;
+  }
+};
+
+class Probe {
+public:
+  static constexpr const char *Name = "Probe";
+  static constexpr identifier_t ID = ids::Probe;
+  static constexpr BufferType Type = BufferType::FixedSize;
+  using FixedType = ProbeMessage;
+
+private:
+  Context &C;
+
+public:
+  Probe(Context &C) : C(C) {}
+
+  bool parse(const ProbeMessage *Object) {
+    if (not C.SaidHello)
+      return false;
+    log("Probe(Sequence: %ld)\n", Object->Sequence);
+
+    if (C.PendingProbesCount == C.PendingProbes.size())
+      return false;
+
+    ProbeReply &Reply = C.PendingProbes[C.PendingProbesCount++];
+    Reply = {};
+    Reply.Sequence = Object->Sequence;
+    Reply.HeaderMicros = C.HeaderMicros;
+    Reply.ParsedMicros = micros();
+    return true;
+  }
+};
+
+Context C;
+
+static int Input = STDIN_FILENO;
+
+void setInput(int NewInput) { Input = NewInput; }
+
+static Framing::Decoder TheDecoder;
+
+template <typename T> bool parseFixedSize(ArrayRef<const uint8_t> Payload) {
+  Trace TT(event_ids::ParseFixedSize, Payload.Size);
+  log("Got command %s\n", T::Name);
+
+  // Fixed-size payloads are small, copy them out for proper alignment
+  typename T::FixedType Object;
+  memcpy(&Object, Payload.Data, sizeof(Object));
+
   T Instance(C);
-  Instance.parse(read<typename T::FixedType>());
+  return Instance.parse(&Object);
 }
 
-template <typename T> void parseArray(length_t Length) {
-  Trace TT(event_ids::ParseArray, Length);
-  constexpr size_t ElementSize = sizeof(typename T::ArrayType);
-  assert(Length % ElementSize == 0);
-  length_t Elements = Length / ElementSize;
+template <typename T> bool parseArray(ArrayRef<const uint8_t> Payload) {
+  Trace TT(event_ids::ParseArray, Payload.Size);
+  log("Got command %s\n", T::Name);
+  using ArrayType = typename T::ArrayType;
+  static_assert(alignof(ArrayType) == 1,
+                "Array elements are accessed directly in the frame buffer");
+
+  size_t Elements = Payload.Size / sizeof(ArrayType);
   log("Got array of %ld elements\n", Elements);
   T Instance(C);
   {
     Trace TTT(event_ids::PreParse);
-    Instance.preparse(Elements);
+    if (not Instance.preparse(Elements))
+      return false;
   }
-  for (length_t I = 0; I < Elements; ++I) {
+
+  const auto *Array = reinterpret_cast<const ArrayType *>(Payload.Data);
+  for (size_t I = 0; I < Elements; ++I) {
     Trace TTT(event_ids::ParseOne, I);
-    Instance.parseOne(read<typename T::ArrayType>());
+    if (not Instance.parseOne(&Array[I]))
+      return false;
   }
+
+  return true;
 }
 
-template <typename T> void dispatch(length_t Length) {
+template <typename T> bool parseBytes(ArrayRef<const uint8_t> Payload) {
   log("Got command %s\n", T::Name);
+  T Instance(C);
+  return Instance.parse(Payload);
+}
+
+/// Everything needed to validate and dispatch a command, derived from its
+/// class
+struct CommandInfo {
+  using handler_t = bool (*)(ArrayRef<const uint8_t> Payload);
+
+  const char *Name = nullptr;
+  handler_t Handler = nullptr;
+  BufferType Type = BufferType::FixedSize;
+  /// Size of the payload for fixed-size commands, of an element for arrays
+  length_t Size = 0;
+
+  bool accepts(length_t Length) const {
+    switch (Type) {
+    case BufferType::FixedSize:
+      return Length == Size;
+    case BufferType::Array:
+      return Length % Size == 0;
+    case BufferType::Bytes:
+      return true;
+    }
+    return false;
+  }
+};
 
+template <typename T> constexpr CommandInfo makeInfo() {
   if constexpr (T::Type == BufferType::FixedSize) {
-    parseFixedSize<T>(Length);
+    return {T::Name, &parseFixedSize<T>, T::Type,
+            sizeof(typename T::FixedType)};
   } else if constexpr (T::Type == BufferType::Array) {
-    parseArray<T>(Length);
+    return {T::Name, &parseArray<T>, T::Type, sizeof(typename T::ArrayType)};
   } else {
-    abort();
+    static_assert(T::Type == BufferType::Bytes);
+    return {T::Name, &parseBytes<T>, T::Type, 1};
   }
 }
 
-ArrayRef<uint8_t> read(size_t Size) {
-  Trace T(event_ids::Read, Size);
-  assert(Size <= MaxReadSize);
-  static uint8_t ReadBuffer[MaxReadSize];
-  size_t ReadData = fread(&ReadBuffer, 1, Size, stdin);
-  assert(ReadData == Size);
+/// The set of supported commands. Everything about them is generated at
+/// compile time from the list: a table indexed by identifier, so that
+/// dispatching takes a single indirect call, the length checks and the
+/// protocol description.
+template <typename... Commands> class Registry {
+public:
+  static constexpr size_t Size = std::max({size_t(Commands::ID)...}) + 1;
 
-#if 0
-  static size_t UnackedBytes = 0;
-  UnackedBytes += ReadData;
-  while (UnackedBytes >= 16) {
-    puts("A16");
-    UnackedBytes -= 16;
+private:
+  static constexpr bool hasUniqueIDs() {
+    std::array<bool, Size> Seen{};
+    bool Result = true;
+    ((Result = Result and not std::exchange(Seen[Commands::ID], true)), ...);
+    return Result;
   }
-#endif
+
+  static_assert(hasUniqueIDs(), "Two commands share the same identifier");
+  static_assert(Size <= Stats::MaxCommands,
+                "Not enough per-command counters in Stats");
+
+public:
+  static constexpr std::array<CommandInfo, Size> Table = [] {
+    std::array<CommandInfo, Size> Result{};
+    ((Result[Commands::ID] = makeInfo<Commands>()), ...);
+    return Result;
+  }();
+
+  /// Return the command with identifier ID, or nullptr if there's none
+  static const CommandInfo *find(identifier_t ID) {
+    if (ID >= Size or Table[ID].Handler == nullptr)
+      return nullptr;
+    return &Table[ID];
+  }
+};
+
+using Commands = Registry<Helo, UpdateRange, MoveCursor, Configure, SetOutput,
+                          SetPowerBudget, GetStats, Probe, UpdateTarget, Tween,
+                          UploadAnimation, PlayAnimation, SetBootFrame,
+                          SelectLayer, ConfigureLayer, SetTile, Present>;
+
+/// Parse all the commands in a frame that passed the CRC check. Commands that
+/// are invalid are rejected, but, since their length is trustworthy, parsing
+/// can continue with the next one.
+void parseFrame(ArrayRef<const uint8_t> Frame) {
+  constexpr size_t HeaderSize = sizeof(identifier_t) + sizeof(length_t);
 
 #ifdef VERBOSE
-  for (size_t I = 0; I < Size; ++I) {
-    log("%.2x ", ReadBuffer[I]);
+  for (size_t I = 0; I < Frame.Size; ++I) {
+    log("%.2x ", Frame.Data[I]);
   }
   puts("");
 #endif
 
-  return ArrayRef{&ReadBuffer[0], Size};
-}
+  size_t Offset = 0;
+  while (Offset < Frame.Size) {
+    if (Frame.Size - Offset < HeaderSize) {
+      ++Statistics.ParseErrors;
+      return;
+    }
 
-bool hasData() {
-  Trace T(event_ids::HasData);
-  // TODO
-  return true;
+    identifier_t ID;
+    length_t Length;
+    memcpy(&ID, &Frame.Data[Offset], sizeof(ID));
+    memcpy(&Length, &Frame.Data[Offset + sizeof(ID)], sizeof(Length));
+    Offset += HeaderSize;
+    C.HeaderMicros = micros();
+    log("ID: %d length: %ld\n", ID, Length);
+
+    if (Length > Frame.Size - Offset) {
+      ++Statistics.ParseErrors;
+      return;
+    }
+
+    Measure M(Statistics.Parse);
+    Statistics.PayloadBytes += Length;
+
+    const CommandInfo *Info = Commands::find(ID);
+    if (Info != nullptr)
+      ++Statistics.Commands[ID];
+
+    if (Info == nullptr or not Info->accepts(Length) or
+        not Info->Handler({&Frame.Data[Offset], Length}))
+      ++Statistics.ParseErrors;
+    Offset += Length;
+
+    puts("ACK");
+  }
 }
 
-void parse() {
+bool parse() {
   Trace T(event_ids::Parse);
 
-  if (hasData()) {
-    identifier_t ID = *read<identifier_t>();
-    length_t Length = *read<length_t>();
-    log("ID: %d length: %ld\n", ID, Length);
+  // Once a Present has been parsed, the rest waits for the next frame
+  auto OnFrame = [](ArrayRef<const uint8_t> Frame) {
+    parseFrame(Frame);
+    if (C.Synchronized and C.Presented)
+      TheDecoder.pause();
+  };
 
-    switch (ID) {
-    case Helo::ID:
-      dispatch<Helo>(Length);
-      break;
+  if (C.Synchronized and C.Presented)
+    return true;
 
-    case UpdateRange::ID:
-      dispatch<UpdateRange>(Length);
-      break;
+  if (TheDecoder.pending()) {
+    TheDecoder.commit(0, OnFrame);
+    return true;
+  }
 
-    case MoveCursor::ID:
-      dispatch<MoveCursor>(Length);
+  ArrayRef<uint8_t> Space = TheDecoder.space();
+  ssize_t Size;
+  {
+    Trace TT(event_ids::Read, Space.Size);
+    Size = ::read(Input, Space.Data, Space.Size);
+  }
+
+  // Nothing available right now
+  if (Size < 0)
+    return true;
+
+  if (Size == 0)
+    return false;
+
+  TheDecoder.commit(Size, OnFrame);
+  return true;
+}
+
+void waitForInput(uint64_t TimeoutMicros) {
+  bool Paused = C.Synchronized and C.Presented;
+  if (TheDecoder.pending() and not Paused)
+    return;
+
+  // With no descriptor to watch, select just sleeps
+  fd_set Readable;
+  FD_ZERO(&Readable);
+  if (not Paused)
+    FD_SET(Input, &Readable);
+  timeval Timeout;
+  Timeout.tv_sec = TimeoutMicros / 1000000;
+  Timeout.tv_usec = TimeoutMicros % 1000000;
+  Trace T(event_ids::HasData);
+  select(Input + 1, &Readable, nullptr, nullptr, &Timeout);
+}
+
+void describe(FILE *Output) {
+  fprintf(Output, "{\n");
+  fprintf(Output, "  \"identifier_size\": %zu,\n", sizeof(identifier_t));
+  fprintf(Output, "  \"length_size\": %zu,\n", sizeof(length_t));
+  fprintf(Output, "  \"max_frame_payload\": %zu,\n", Framing::MaxPayload);
+  fprintf(Output, "  \"commands\": [");
+  const char *Separator = "\n";
+  for (size_t ID = 0; ID < Commands::Size; ++ID) {
+    const CommandInfo &Info = Commands::Table[ID];
+    if (Info.Handler == nullptr)
+      continue;
+
+    fprintf(Output, "%s    {\"id\": %zu, \"name\": \"%s\", ", Separator, ID,
+            Info.Name);
+    switch (Info.Type) {
+    case BufferType::FixedSize:
+      fprintf(Output, "\"payload\": \"fixed\", \"size\": %u}",
+              unsigned(Info.Size));
+      break;
+    case BufferType::Array:
+      fprintf(Output, "\"payload\": \"array\", \"element_size\": %u}",
+              unsigned(Info.Size));
+      break;
+    case BufferType::Bytes:
+      fprintf(Output, "\"payload\": \"bytes\"}");
       break;
     }
+    Separator = ",\n";
+  }
+  fprintf(Output, "\n  ]\n}\n");
+}
 
-    puts("ACK");
+bool frameReady() { return not C.Synchronized or C.Presented; }
+
+void frameDone() {
+  C.Presented = false;
+
+  // The probes parsed so far made it into the frame that has just been
+  // flushed
+  for (size_t I = 0; I < C.PendingProbesCount; ++I) {
+    ProbeReply &Reply = C.PendingProbes[I];
+    Reply.Frame = LEDs.LastFrame.Number;
+    Reply.RenderedMicros = LEDs.LastFrame.StartMicros;
+    Reply.FlushedMicros = LEDs.LastFrame.FlushedMicros;
+    reply("PROBE", &Reply, sizeof(Reply));
+  }
+  C.PendingProbesCount = 0;
+
+  if (C.Player.playing()) {
+    if (C.Player.advance())
+      LEDs.showExternal(C.Player.format(), C.Player.frame());
+    else
+      LEDs.showLEDs();
   }
 }
 
+bool animating() { return C.Player.playing(); }
+
 }
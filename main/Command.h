@@ -2,15 +2,43 @@
 
 extern "C" {
 #include <string.h>
+#include <unistd.h>
 }
 
+#include "Animation.h"
+#include "Framing.h"
 #include "LED.h"
 #include "Logging.h"
+#include "Protocol.h"
+#include "Snapshot.h"
 
 // #define VERBOSE
 
 namespace Command {
 
-void parse();
+/// Read commands from the file descriptor Input instead of the standard input
+void setInput(int Input);
+
+/// Parse the commands in the data available on the input, returns false if
+/// the input has been closed
+bool parse();
+
+/// Wait up to TimeoutMicros for something to parse. Returns as soon as there
+/// is, and takes the whole time if parsing waits for the next frame.
+void waitForInput(uint64_t TimeoutMicros);
+
+/// Write to Output a JSON description of the supported commands and of their
+/// payloads, for host tools
+void describe(FILE *Output);
+
+/// Whether an animation is being played
+bool animating();
+
+/// Whether a frame should be rendered now. Tiles in synchronized mode render
+/// only once a Present has been received.
+bool frameReady();
+
+/// To be called after each frame has been rendered and flushed
+void frameDone();
 
 } // namespace Command
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <stdint.h>
+
+#include "Colors.h"
+
+/// Encoding of colors into the waveform expected by WS2812 LEDs. Each data bit
+/// becomes four output slots (1110 for a one, 1000 for a zero) so that the
+/// result can be shifted out verbatim by a peripheral clocked at 3.2 MHz.
+namespace WS2812 {
+
+constexpr unsigned SlotsPerBit = 4;
+
+/// The slots for a single data byte, in transmission order
+using EncodedByte = std::array<uint8_t, SlotsPerBit>;
+
+/// The slots for a single LED, channels are sent as green, red, blue
+using EncodedLED = std::array<EncodedByte, 3>;
+
+constexpr EncodedByte encodeSlow(uint8_t Byte) {
+  EncodedByte Result{};
+  for (unsigned Bit = 0; Bit < 8; ++Bit) {
+    bool One = (Byte >> (7 - Bit)) & 1;
+    uint8_t Slots = One ? 0b1110 : 0b1000;
+    Result[Bit / 2] |= Slots << ((Bit % 2) ? 0 : 4);
+  }
+  return Result;
+}
+
+constexpr std::array<EncodedByte, 256> makeTable() {
+  std::array<EncodedByte, 256> Result{};
+  for (unsigned I = 0; I < Result.size(); ++I)
+    Result[I] = encodeSlow(I);
+  return Result;
+}
+
+inline constexpr std::array<EncodedByte, 256> Table = makeTable();
+
+static_assert(Table[0] == EncodedByte{0x88, 0x88, 0x88, 0x88});
+static_assert(Table[0xFF] == EncodedByte{0xEE, 0xEE, 0xEE, 0xEE});
+static_assert(Table[0x81] == EncodedByte{0xE8, 0x88, 0x88, 0x8E});
+
+inline EncodedLED encode(const RGBColor &Color) {
+  return {Table[Color.Green], Table[Color.Red], Table[Color.Blue]};
+}
+
+/// Recover a data byte from its slots, looking at the middle slot of each bit
+inline uint8_t decode(const EncodedByte &Slots) {
+  uint8_t Result = 0;
+  for (unsigned Bit = 0; Bit < 8; ++Bit) {
+    uint8_t BitSlots = Slots[Bit / 2] >> ((Bit % 2) ? 0 : 4);
+    Result = (Result << 1) | ((BitSlots >> 1) & 1);
+  }
+  return Result;
+}
+
+inline RGBColor decode(const EncodedLED &LED) {
+  return RGBColor(decode(LED[1]), decode(LED[0]), decode(LED[2]));
+}
+
+} // namespace WS2812
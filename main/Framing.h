@@ -0,0 +1,204 @@
+#pragma once
+
+#include <array>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ArrayRef.h"
+#include "Stats.h"
+
+/// Framing of the command stream.
+///
+/// Each frame carries one or more commands followed by the CRC-32 (as in zlib)
+/// of the commands, little endian. The whole is COBS-encoded, so that it
+/// contains no zero byte, and terminated by a zero byte. A corrupted frame is
+/// dropped as a whole and decoding resumes at the next delimiter.
+namespace Framing {
+
+constexpr uint8_t Delimiter = 0;
+constexpr size_t CRCSize = sizeof(uint32_t);
+
+/// Maximum size of the commands in a single frame
+constexpr size_t MaxPayload = 1024;
+
+/// Maximum size of a frame on the wire, delimiter excluded
+constexpr size_t MaxEncodedSize =
+    MaxPayload + CRCSize + (MaxPayload + CRCSize) / 254 + 1;
+
+constexpr std::array<uint32_t, 256> makeCRCTable() {
+  std::array<uint32_t, 256> Result{};
+  for (uint32_t I = 0; I < Result.size(); ++I) {
+    uint32_t Value = I;
+    for (unsigned Bit = 0; Bit < 8; ++Bit)
+      Value = (Value & 1) ? (Value >> 1) ^ 0xEDB88320 : Value >> 1;
+    Result[I] = Value;
+  }
+  return Result;
+}
+
+inline constexpr std::array<uint32_t, 256> CRCTable = makeCRCTable();
+
+constexpr uint32_t crc32(const uint8_t *Data, size_t Size) {
+  uint32_t Result = 0xFFFFFFFF;
+  for (size_t I = 0; I < Size; ++I)
+    Result = CRCTable[(Result ^ Data[I]) & 0xFF] ^ (Result >> 8);
+  return ~Result;
+}
+
+namespace detail {
+constexpr uint8_t CheckInput[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+static_assert(crc32(CheckInput, sizeof(CheckInput)) == 0xCBF43926);
+} // namespace detail
+
+/// Decode in place the COBS-encoded Data, returning the decoded size or
+/// SIZE_MAX if Data is not valid COBS
+inline size_t decodeCOBS(uint8_t *Data, size_t Size) {
+  size_t Read = 0;
+  size_t Written = 0;
+  while (Read < Size) {
+    uint8_t Code = Data[Read++];
+    if (Code == 0 or Read + Code - 1 > Size)
+      return SIZE_MAX;
+
+    for (unsigned I = 1; I < Code; ++I)
+      Data[Written++] = Data[Read++];
+
+    // A code of 0xFF is not followed by an implicit zero, nor is the last one
+    if (Code != 0xFF and Read < Size)
+      Data[Written++] = 0;
+  }
+  return Written;
+}
+
+/// Append to Output the frame carrying Payload, delimiter included
+template <typename OutputType>
+void encode(const uint8_t *Payload, size_t Size, OutputType &Output) {
+  uint32_t CRC = crc32(Payload, Size);
+  uint8_t CRCBytes[CRCSize] = {uint8_t(CRC), uint8_t(CRC >> 8),
+                               uint8_t(CRC >> 16), uint8_t(CRC >> 24)};
+  auto At = [&](size_t I) {
+    return I < Size ? Payload[I] : CRCBytes[I - Size];
+  };
+
+  size_t Total = Size + CRCSize;
+  size_t CodeIndex = Output.size();
+  Output.push_back(0);
+  uint8_t Code = 1;
+  for (size_t I = 0; I < Total; ++I) {
+    if (At(I) == 0) {
+      Output[CodeIndex] = Code;
+      CodeIndex = Output.size();
+      Output.push_back(0);
+      Code = 1;
+    } else {
+      Output.push_back(At(I));
+      if (++Code == 0xFF and I + 1 < Total) {
+        Output[CodeIndex] = Code;
+        CodeIndex = Output.size();
+        Output.push_back(0);
+        Code = 1;
+      }
+    }
+  }
+  Output[CodeIndex] = Code;
+  Output.push_back(Delimiter);
+}
+
+/// Incremental decoder: data is read directly into space(), then commit
+/// decodes in place each complete frame and hands its payload to a callback,
+/// without further copies
+class Decoder {
+private:
+  std::array<uint8_t, MaxEncodedSize + 1> Buffer;
+  size_t Used = 0;
+  /// The first Scanned bytes of Buffer contain no delimiter
+  size_t Scanned = 0;
+
+  /// Set after an overflow, until the next delimiter
+  bool Discarding = false;
+
+  /// Stop processing frames, see pause
+  bool Paused = false;
+
+public:
+  /// Where the next incoming bytes should be stored
+  ArrayRef<uint8_t> space() {
+    return ArrayRef<uint8_t>(&Buffer[Used], Buffer.size() - Used);
+  }
+
+  /// Whether frames left over by pause might be waiting in the buffer, in
+  /// which case commit(0, OnFrame) processes them
+  bool pending() const { return Scanned < Used; }
+
+  /// To be called from OnFrame, stops commit after the current frame. The
+  /// rest of the data is kept for the next commit.
+  void pause() { Paused = true; }
+
+  /// Process Count bytes stored in space(), calling OnFrame with the payload
+  /// of each valid frame
+  template <typename F> void commit(size_t Count, F &&OnFrame) {
+    Paused = false;
+    size_t FrameStart = 0;
+    size_t Scan = Scanned;
+    size_t End = Used + Count;
+
+    while (Scan < End and not Paused) {
+      auto *Found = static_cast<uint8_t *>(
+          memchr(&Buffer[Scan], Delimiter, End - Scan));
+      if (Found == nullptr) {
+        Scan = End;
+        break;
+      }
+
+      size_t DelimiterIndex = Found - &Buffer[0];
+      processFrame(&Buffer[FrameStart], DelimiterIndex - FrameStart, OnFrame);
+      FrameStart = DelimiterIndex + 1;
+      Scan = FrameStart;
+    }
+
+    // Keep the incomplete frame for the next round, unless it's too large
+    Used = End - FrameStart;
+    Scanned = Scan - FrameStart;
+    memmove(&Buffer[0], &Buffer[FrameStart], Used);
+    if (Used == Buffer.size() and not pending()) {
+      ++Statistics.Overflows;
+      Discarding = true;
+      Used = 0;
+      Scanned = 0;
+    }
+  }
+
+private:
+  template <typename F>
+  void processFrame(uint8_t *Data, size_t Size, F &&OnFrame) {
+    if (Discarding) {
+      Discarding = false;
+      return;
+    }
+
+    // Empty frames can be used to resynchronize
+    if (Size == 0)
+      return;
+
+    size_t Decoded = decodeCOBS(Data, Size);
+    if (Decoded == SIZE_MAX or Decoded < CRCSize) {
+      ++Statistics.FramingErrors;
+      return;
+    }
+
+    size_t PayloadSize = Decoded - CRCSize;
+    const uint8_t *CRCBytes = Data + PayloadSize;
+    uint32_t Expected = CRCBytes[0] | (CRCBytes[1] << 8) |
+                        (CRCBytes[2] << 16) | (uint32_t(CRCBytes[3]) << 24);
+    if (crc32(Data, PayloadSize) != Expected) {
+      ++Statistics.CRCErrors;
+      return;
+    }
+
+    ++Statistics.ReceivedFrames;
+    OnFrame(ArrayRef<const uint8_t>(Data, PayloadSize));
+  }
+};
+
+} // namespace Framing
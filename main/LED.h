@@ -1,9 +1,36 @@
 #pragma once
 
+#include <algorithm>
+#include <type_traits>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
 #include "ArrayRef.h"
+#include "BitSet.h"
 #include "Colors.h"
 #include "CoordinateSystem.h"
+#include "Encoding.h"
 #include "Logging.h"
+#include "Output.h"
+#include "Scheduler.h"
+#include "Stats.h"
+
+#ifndef ESP_PLATFORM
+/// On the host, the buffers written to the pins are handed to this function,
+/// if set, e.g., to emulate the strips
+inline void (*HostPinSink)(size_t Gpio, ArrayRef<const uint8_t> Buffer) =
+    nullptr;
+#endif
+
+/// Whether the LEDs are stored with 16 bits per channel and dithered to 8
+/// bits on output, see Strip
+#ifdef CONFIG_LEDIAN_DEEP_COLOR
+constexpr bool DeepColor = true;
+#else
+constexpr bool DeepColor = false;
+#endif
 
 template <size_t Gpio, size_t Index> struct WS2812Pin {
 
@@ -16,7 +43,12 @@ template <size_t Gpio, size_t Index> struct WS2812Pin {
   }
 
   static void writeBuffer(ArrayRef<const uint8_t> Buffer) {
+#ifdef ESP_PLATFORM
     // TODO
+#else
+    if (HostPinSink != nullptr)
+      HostPinSink(Gpio, Buffer);
+#endif
   }
 };
 
@@ -34,27 +66,211 @@ public:
       : Color(Color.toHSVColor()), Blink(Blink) {}
 
 public:
+  bool operator==(const LEDDescriptor &Other) const = default;
+
   bool verify() const { return Blink < 2; }
 };
 
 static_assert(sizeof(HSVColor) == 3);
 static_assert(sizeof(LEDDescriptor) == 4);
 
-template <size_t MaxSize> struct Strip {
+/// Number of layers on top of the LEDs, which are layer 0
+constexpr size_t Overlays = 2;
+
+/// A layer drawn on top of the LEDs of a strip
+template <size_t MaxSize> struct Overlay {
+  std::array<RGBColor, MaxSize> Colors;
+  /// LEDs where the layer is not transparent
+  BitSet<MaxSize> Covered;
+  /// Sum of all the channels of the covered LEDs
+  uint32_t ChannelSum = 0;
+};
+
+/// How a layer is blended over the ones below
+struct LayerSettings {
+  uint8_t Opacity = 255;
+  /// Writing Key to the layer makes the LED transparent
+  bool Keyed = true;
+  RGBColor Key;
+
+  /// Opacity as an interpolation factor out of 65536
+  uint32_t factor() const { return (Opacity * 65536 + 127) / 255; }
+};
+
+/// The LEDs of a strip and everything needed to render them.
+///
+/// With Deep, the LEDs are stored with 16 bits per channel in Fine and go
+/// through the output stage with temporal dithering, see DitheringStage, so
+/// that dim colors and slow transitions band less. LEDs then holds the same
+/// colors rounded to 8 bits, for everything that does not need the precision,
+/// e.g., the power estimate and the boot frame.
+template <size_t MaxSize, bool Deep = DeepColor> struct Strip {
+  using StoredColor = std::conditional_t<Deep, RGB16Color, RGBColor>;
+
+  /// Number of encoded buffers, one per dither phase
+  static constexpr size_t Phases = Deep ? DitherPhases : 1;
+
   std::array<RGBColor, MaxSize> LEDs;
-  std::array<uint8_t, (MaxSize + 7) / 8> Blink;
+  BitSet<MaxSize> Blink;
+
+  std::array<RGB16Color, Deep ? MaxSize : 0> Fine;
+
+  /// What is actually sent to the strip: LEDs after blinking and the output
+  /// stage have been applied, already encoded for the wire. It persists across
+  /// frames and only the LEDs marked in Dirty are re-encoded. With Deep, each
+  /// dither phase has its own buffer, shown in turn, so that static LEDs are
+  /// not encoded again even if their output changes from frame to frame.
+  std::array<std::array<WS2812::EncodedLED, MaxSize>, Phases> Encoded;
+  BitSet<MaxSize> Dirty;
+  /// With Deep, the LEDs changed since each buffer was last encoded: a change
+  /// reaches a buffer the next time its phase is shown
+  std::array<BitSet<MaxSize>, Deep ? Phases : 0> Stale;
+
+  /// Sum of all the channels of all the LEDs, kept up to date by write
+  uint32_t ChannelSum = 0;
+
+  /// Bumped by every change to LEDs or Blink
+  uint32_t Revision = 0;
+
+  /// Colors the LEDs are transitioning to, see LEDArray::startTween. Only
+  /// meaningful for the LEDs in Staged or Tweening.
+  std::array<StoredColor, MaxSize> Target;
+  /// Colors the LEDs had when their transition started, only meaningful for
+  /// the LEDs in Tweening
+  std::array<StoredColor, MaxSize> Start;
+  /// LEDs whose target has been set since the last transition started
+  BitSet<MaxSize> Staged;
+  /// LEDs that have not reached their target yet
+  BitSet<MaxSize> Tweening;
+
+  std::array<Overlay<MaxSize>, Overlays> Layers;
+
+  Strip() { Dirty.setAll(); }
+
+  void write(size_t Index, const RGBColor &Color) {
+    if constexpr (Deep)
+      Fine[Index] = RGB16Color(Color);
+    writeRounded(Index, Color);
+  }
+
+  void write(size_t Index, const RGB16Color &Color)
+    requires Deep
+  {
+    Fine[Index] = Color;
+    writeRounded(Index, Color.toRGBColor());
+  }
+
+  /// The color of an LED, at the precision it's stored with
+  StoredColor color(size_t Index) const {
+    if constexpr (Deep)
+      return Fine[Index];
+    else
+      return LEDs[Index];
+  }
+
+  /// Set an LED right away, overriding any transition it is part of
+  template <typename ColorType> void set(size_t Index, const ColorType &Color) {
+    write(Index, Color);
+    Staged.clear(Index);
+    Tweening.clear(Index);
+  }
+
+  /// Write Color to overlay Layer, or make it transparent there
+  void writeOverlay(size_t Layer, size_t Index, const RGBColor &Color,
+                    bool Transparent) {
+    Overlay<MaxSize> &TheLayer = Layers[Layer];
+    if (TheLayer.Covered.test(Index))
+      TheLayer.ChannelSum -= TheLayer.Colors[Index].sum();
+    if (Transparent) {
+      TheLayer.Covered.clear(Index);
+    } else {
+      TheLayer.Covered.set(Index);
+      TheLayer.ChannelSum += Color.sum();
+    }
+    TheLayer.Colors[Index] = Color;
+    Dirty.set(Index);
+  }
+
+  void setTarget(size_t Index, const StoredColor &Color) {
+    Target[Index] = Color;
+    Staged.set(Index);
+  }
 
-  bool blinks(size_t Index) const {
-    return (((Blink[Index / 8] >> (Index % 8)) & 1) != 0);
+  bool blinks(size_t Index) const { return Blink.test(Index); }
+
+  void setBlinking(size_t Index) {
+    Blink.set(Index);
+    ++Revision;
+  }
+
+  void clearBlinking(size_t Index) {
+    // The encoded LED might still have the blinking brightness
+    if (Blink.test(Index))
+      Dirty.set(Index);
+    Blink.clear(Index);
+    ++Revision;
+  }
+
+  /// The bytes to send to the strip in dither phase Phase, given it has Size
+  /// LEDs
+  ArrayRef<const uint8_t> buffer(size_t Size, size_t Phase) const {
+    return {reinterpret_cast<const uint8_t *>(&Encoded[Phase][0]),
+            Size * sizeof(WS2812::EncodedLED)};
   }
 
-  void setBlinking(size_t Index) { Blink[Index / 8] |= 1 << (Index % 8); }
+private:
+  void writeRounded(size_t Index, const RGBColor &Color) {
+    ChannelSum -= LEDs[Index].sum();
+    ChannelSum += Color.sum();
+    LEDs[Index] = Color;
+    Dirty.set(Index);
+    ++Revision;
+  }
+};
+
+/// Rough model of the current drawn by a WS2812 LED
+namespace Power {
+/// Current drawn by a single channel at full brightness
+constexpr uint32_t MilliampsPerChannel = 20;
+/// Current drawn by an LED when all its channels are off
+constexpr uint32_t IdleMilliampsPerLED = 1;
+} // namespace Power
 
-  void clearBlinking(size_t Index) { Blink[Index / 8] &= ~(1 << (Index % 8)); }
+struct PowerStats {
+  /// Estimated current draw of the last frame, before limiting
+  uint32_t EstimatedMilliamps = 0;
+  /// Scaling factor (out of 256) applied by the limiter to the last frame
+  uint16_t Limit = OutputStage::NoLimit;
+  /// Number of frames whose brightness has been reduced by the limiter
+  uint32_t LimitedFrames = 0;
 };
 
-template <size_t MaxSize, size_t MaxPorts> struct LEDArray {
+/// How a frame shown instead of the LEDs, see LEDArray::showExternal, is
+/// stored. In both cases strips follow each other, each one with LEDArray::size
+/// LEDs in physical order.
+enum class ExternalFormat : uint8_t {
+  None,
+  /// RGBColor per LED, still to go through the output stage
+  RGB,
+  /// WS2812::EncodedLED per LED, sent to the strips as is
+  Encoded
+};
+
+/// When the last frame has been produced
+struct FrameTimes {
+  uint32_t Number = 0;
+  /// Beginning of the render, anything set before this is in the frame
+  uint64_t StartMicros = 0;
+  /// Completion of the flush of the last strip
+  uint64_t FlushedMicros = 0;
+};
+
+template <size_t MaxSize, size_t MaxPorts, bool Deep = DeepColor>
+struct LEDArray {
 public:
+  using StripType = Strip<MaxSize, Deep>;
+  using StoredColor = typename StripType::StoredColor;
+
   // TODO: hardcoded and redundants
   using TheCoordinateSystem =
       CoordinateSystem<4, 2,
@@ -64,28 +280,175 @@ public:
                                             Panel{Corner::SouthEast, 3}},
                        40, 11>;
 
-  LEDArray() : ActualSize(MaxSize) {}
-  std::array<Strip<MaxSize>, MaxPorts> Strips;
+  LEDArray() : ActualSize(MaxSize), Workers(&LEDArray::encodeJob, this) {
+    for (size_t L = 0; L < Overlays; ++L)
+      LayerFactors[L] = Layers[L].factor();
+  }
+  std::array<StripType, MaxPorts> Strips;
+
+  OutputStage Stage;
+  /// With Deep, Stage for the 16-bit LEDs, kept in sync with it by render
+  std::array<DitheringStage, Deep ? 1 : 0> Dithering;
+
+  /// Maximum current the strips can draw, 0 means no limit
+  uint32_t MilliampBudget = 0;
+  PowerStats Power;
+
+  FrameTimes LastFrame;
+
+  /// Settings of layers 1 and above, use configureLayer to change them
+  std::array<LayerSettings, Overlays> Layers;
 
 private:
+  using BitSetType = BitSet<MaxSize>;
+
+  /// Each strip is encoded in chunks of this many bitset words, which are the
+  /// unit of work handed out to the render threads
+  static constexpr size_t ChunkWords = 4;
+  static constexpr size_t ChunksPerStrip =
+      (BitSetType::WordCount + ChunkWords - 1) / ChunkWords;
+
   size_t ActualSize;
+  ExternalFormat External = ExternalFormat::None;
+  const uint8_t *ExternalData = nullptr;
+  /// Length of the current transition and frames of it already rendered
+  uint32_t TweenFrames = 0;
+  uint32_t TweenElapsed = 0;
+  uint32_t EncodedStageVersion = 0;
+  uint16_t FrameBlinkScale = 0;
+  /// Dither phase of the frame being rendered
+  size_t FramePhase = 0;
+  std::array<uint32_t, Overlays> LayerFactors;
+  uint32_t FrameFlushMicros = 0;
+  Scheduler<MaxPorts, ChunksPerStrip> Workers;
 
 public:
   size_t size() const { return ActualSize; }
 
+  /// Render using Threads threads in total, i.e., the calling one plus
+  /// Threads - 1 workers. Can be called only once.
+  void setRenderThreads(size_t Threads) {
+    assert(Threads >= 1);
+    Workers.startWorkers(Threads - 1);
+  }
+
 public:
-  void set(size_t Column, size_t Line, const RGBColor &Color, bool Blink) {
+  /// Convert a color received from the host to the precision of the LEDs
+  static StoredColor toStored(const HSVColor &Color) {
+    if constexpr (Deep)
+      return Color.toRGB16Color();
+    else
+      return Color.toRGBColor();
+  }
+
+  template <typename ColorType>
+  void set(size_t Column, size_t Line, const ColorType &Color, bool Blink) {
     LEDCoordinate Coordinate =
         TheCoordinateSystem::convert(Point{Column, Line});
     log("LEDArray.set(Column: %d, Line: %d)", Column, Line);
     log(", setting (StripIndex: %d, LEDIndex: %d)\n", Coordinate.StripIndex,
         Coordinate.LEDIndex);
     auto &Strip = Strips[Coordinate.StripIndex];
-    Strip.LEDs[Coordinate.LEDIndex] = Color;
-    if (Blink)
-      Strip.setBlinking(Coordinate.LEDIndex);
-    else
-      Strip.clearBlinking(Coordinate.LEDIndex);
+    Strip.set(Coordinate.LEDIndex, Color);
+    setBlinking(Strip, Coordinate.LEDIndex, Blink);
+  }
+
+  /// Write Color to Layer, 0 being the LEDs and the others overlays. Blinking
+  /// applies to the LEDs only.
+  void setInLayer(size_t Layer, size_t Column, size_t Line,
+                  const HSVColor &Color, bool Blink) {
+    if (Layer == 0) {
+      set(Column, Line, toStored(Color), Blink);
+      return;
+    }
+
+    LEDCoordinate Coordinate =
+        TheCoordinateSystem::convert(Point{Column, Line});
+    const LayerSettings &Settings = Layers[Layer - 1];
+    RGBColor OverlayColor = Color.toRGBColor();
+    bool Transparent = Settings.Keyed and OverlayColor == Settings.Key;
+    Strips[Coordinate.StripIndex].writeOverlay(Layer - 1, Coordinate.LEDIndex,
+                                               OverlayColor, Transparent);
+  }
+
+  /// Change the settings of overlay Layer (1 or above). LEDs already written
+  /// with the new key become transparent, with Clear the whole layer does.
+  void configureLayer(size_t Layer, const LayerSettings &Settings,
+                      bool Clear) {
+    assert(Layer >= 1 and Layer <= Overlays);
+    size_t Index = Layer - 1;
+    Layers[Index] = Settings;
+    LayerFactors[Index] = Settings.factor();
+
+    for (auto &Strip : Strips) {
+      Overlay<MaxSize> &TheLayer = Strip.Layers[Index];
+      for (size_t I = 0; I < MaxSize; ++I) {
+        if (not TheLayer.Covered.test(I))
+          continue;
+
+        // Whatever the layer covered has to be composited again
+        Strip.Dirty.set(I);
+        if (Clear or (Settings.Keyed and TheLayer.Colors[I] == Settings.Key))
+          Strip.writeOverlay(Index, I, TheLayer.Colors[I], true);
+      }
+    }
+  }
+
+  /// Stage the color an LED will transition to with the next startTween.
+  /// Blinking takes effect right away.
+  void setTarget(size_t Column, size_t Line, const HSVColor &Color,
+                 bool Blink) {
+    LEDCoordinate Coordinate =
+        TheCoordinateSystem::convert(Point{Column, Line});
+    auto &Strip = Strips[Coordinate.StripIndex];
+    Strip.setTarget(Coordinate.LEDIndex, toStored(Color));
+    setBlinking(Strip, Coordinate.LEDIndex, Blink);
+  }
+
+  /// Have the staged LEDs transition linearly from their current color to
+  /// their target over the next Frames frames, 0 meaning the next frame. LEDs
+  /// still transitioning from a previous call carry on towards their target,
+  /// at the new pace.
+  void startTween(uint32_t Frames) {
+    constexpr size_t WordBits = BitSetType::WordBits;
+    for (auto &Strip : Strips) {
+      for (size_t WordIndex = 0; WordIndex < BitSetType::WordCount;
+           ++WordIndex) {
+        auto Pending = Strip.Tweening.Words[WordIndex] |
+                       Strip.Staged.Words[WordIndex];
+        Strip.Tweening.Words[WordIndex] = Pending;
+        Strip.Staged.Words[WordIndex] = 0;
+        while (Pending != 0) {
+          size_t I = WordIndex * WordBits + __builtin_ctz(Pending);
+          Pending &= Pending - 1;
+          Strip.Start[I] = Strip.color(I);
+        }
+      }
+    }
+    TweenFrames = std::max<uint32_t>(Frames, 1);
+    TweenElapsed = 0;
+  }
+
+  bool tweening() const { return TweenElapsed != TweenFrames; }
+
+  /// Show Data, laid out according to Format, in the next frames instead of
+  /// the LEDs, e.g., to play an animation straight from flash. The LEDs can
+  /// still be changed in the meantime. Data must stay valid until the next
+  /// call to showExternal or showLEDs.
+  void showExternal(ExternalFormat Format, const uint8_t *Data) {
+    assert(Format != ExternalFormat::None and Data != nullptr);
+    External = Format;
+    ExternalData = Data;
+  }
+
+  /// Go back to showing the LEDs
+  void showLEDs() {
+    // Encoding an RGB external frame overwrote what had been encoded
+    if (External == ExternalFormat::RGB)
+      for (auto &Strip : Strips)
+        Strip.Dirty.setAll();
+    External = ExternalFormat::None;
+    ExternalData = nullptr;
   }
 
   void resize(size_t NewSize) {
@@ -93,7 +456,9 @@ public:
     ActualSize = NewSize;
     for (size_t J = 0; J < MaxPorts; J++) {
       for (size_t I = NewSize; I < MaxSize; ++I) {
-        Strips[J].LEDs[I] = {};
+        Strips[J].set(I, StoredColor());
+        for (size_t L = 0; L < Overlays; ++L)
+          Strips[J].writeOverlay(L, I, {}, true);
       }
     }
   }
@@ -101,38 +466,244 @@ public:
 public:
   void render(size_t Time) {
     Trace TT(event_ids::Render);
-    renderImpl<0>(Time);
+    Measure M(Statistics.Render);
+    uint64_t StartMicros = micros();
+    tween();
+
+    // The power budget is enforced on the LEDs only, external frames are
+    // expected to have been prepared within it
+    if (External == ExternalFormat::None)
+      limitPower();
+
+    // A different output stage invalidates everything that has been encoded
+    if (Stage.version() != EncodedStageVersion) {
+      EncodedStageVersion = Stage.version();
+      if constexpr (Deep)
+        Dithering[0].update(Stage);
+      for (auto &Strip : Strips)
+        Strip.Dirty.setAll();
+    }
+
+    FrameBlinkScale = blinkScale(Time);
+    FramePhase = Time % StripType::Phases;
+    if (Workers.workers() != 0 and External != ExternalFormat::Encoded)
+      Workers.begin();
+
+    FrameFlushMicros = 0;
+    renderImpl<0>();
+    Statistics.Flush.add(FrameFlushMicros);
+
+    M.stop();
+    ++LastFrame.Number;
+    LastFrame.StartMicros = StartMicros;
+    LastFrame.FlushedMicros = micros();
+    ++Statistics.Frames;
+    if (Statistics.Render.LastMicros > Stats::FramePeriodMicros)
+      ++Statistics.Overruns;
+  }
+
+  /// Advance the current transition by one frame. Each LED is placed at
+  /// TweenElapsed/TweenFrames of the way from its start to its target, so that
+  /// every frame rounds to the right color, however small the distance, and
+  /// the last one lands exactly on the target. Only the LEDs still
+  /// transitioning are visited and only those that actually change are
+  /// written, and therefore re-encoded.
+  void tween() {
+    if (not tweening())
+      return;
+
+    Trace TT(event_ids::Tween, TweenFrames - TweenElapsed);
+    constexpr size_t WordBits = BitSetType::WordBits;
+    ++TweenElapsed;
+    uint64_t Factor =
+        ((uint64_t(TweenElapsed) << 32) + TweenFrames - 1) / TweenFrames;
+    for (auto &TheStrip : Strips) {
+      for (size_t WordIndex = 0; WordIndex < BitSetType::WordCount;
+           ++WordIndex) {
+        auto Pending = TheStrip.Tweening.Words[WordIndex];
+        while (Pending != 0) {
+          unsigned Bit = __builtin_ctz(Pending);
+          Pending &= Pending - 1;
+          size_t I = WordIndex * WordBits + Bit;
+
+          const StoredColor &Target = TheStrip.Target[I];
+          StoredColor Color =
+              TheStrip.Start[I].interpolatedPrecisely(Target, Factor);
+          if (Color != TheStrip.color(I))
+            TheStrip.write(I, Color);
+          if (Color == Target)
+            TheStrip.Tweening.clear(I);
+        }
+      }
+    }
   }
 
-  template <size_t J> void renderImpl(size_t Time) {
+  /// Estimate the current the next frame will draw from the running channel
+  /// sums and, if it exceeds MilliampBudget, dim the output stage accordingly.
+  /// The estimate ignores gamma and blinking, which can only lower the draw,
+  /// and adds up the layers, since blending can only yield less than their
+  /// sum.
+  void limitPower() {
+    uint64_t ChannelSum = 0;
+    for (const auto &Strip : Strips) {
+      ChannelSum += Strip.ChannelSum;
+      for (const auto &Layer : Strip.Layers)
+        ChannelSum += Layer.ChannelSum;
+    }
+
+    uint32_t Idle = Power::IdleMilliampsPerLED * ActualSize * MaxPorts;
+    uint32_t Active = (ChannelSum * Power::MilliampsPerChannel *
+                       (Stage.brightness() + 1)) /
+                      (255 * 256);
+    Power.EstimatedMilliamps = Idle + Active;
+
+    uint16_t Limit = OutputStage::NoLimit;
+    if (MilliampBudget != 0 and Power.EstimatedMilliamps > MilliampBudget) {
+      Limit = MilliampBudget > Idle ? ((MilliampBudget - Idle) << 8) / Active
+                                    : 0;
+      ++Power.LimitedFrames;
+    }
+
+    Power.Limit = Limit;
+    Stage.setLimit(Limit);
+  }
+
+  /// Brightness of the blinking LEDs at time Time, as a factor out of 256
+  static uint16_t blinkScale(size_t Time) {
+    constexpr uint8_t MinValue = 0;
+    constexpr uint8_t MaxValue = 10;
+    size_t ScaledTime = Time / 1;
+    unsigned ValueShift = ScaledTime % MaxValue;
+    if ((ScaledTime / MaxValue) & 1)
+      ValueShift = (MaxValue - 1) - ValueShift;
+    ValueShift += MinValue;
+    return ((ValueShift << 8) + MaxValue / 2) / MaxValue;
+  }
+
+  /// Encode the LEDs of strip StripIndex that need it in the words
+  /// [StartWord, EndWord) of the bitsets
+  void encode(size_t StripIndex, size_t StartWord, size_t EndWord) {
+    constexpr size_t WordBits = BitSetType::WordBits;
+    auto &TheStrip = Strips[StripIndex];
+    auto &Encoded = TheStrip.Encoded[FramePhase];
+    size_t End = std::min(EndWord * WordBits, ActualSize);
+
+    // External frames are encoded in full, they do not track changes
+    if (External == ExternalFormat::RGB) {
+      const auto *Source = reinterpret_cast<const RGBColor *>(ExternalData) +
+                           StripIndex * ActualSize;
+      for (size_t I = StartWord * WordBits; I < End; ++I)
+        Encoded[I] = WS2812::encode(Stage.apply(Source[I]));
+      return;
+    }
+
+    // Walk the dirty and blinking bitsets a word at a time, re-encoding only
+    // the LEDs that changed since the buffer was last encoded plus the
+    // blinking ones, which change every frame. Clean words are skipped
+    // altogether.
+    for (size_t Start = StartWord * WordBits; Start < End; Start += WordBits) {
+      size_t WordIndex = Start / WordBits;
+      auto Mask = BitSetType::mask(Start, End);
+      auto Blinking = TheStrip.Blink.Words[WordIndex] & Mask;
+      auto Changed = TheStrip.Dirty.Words[WordIndex] & Mask;
+      TheStrip.Dirty.Words[WordIndex] &= ~Mask;
+      auto Pending = Changed | Blinking;
+      if constexpr (Deep) {
+        for (auto &Phase : TheStrip.Stale)
+          Phase.Words[WordIndex] |= Changed;
+        auto &Stale = TheStrip.Stale[FramePhase].Words[WordIndex];
+        Pending |= Stale & Mask;
+        Stale &= ~Mask;
+      }
+
+      // Blending is needed only where some layer is not transparent
+      typename BitSetType::word_t Covered = 0;
+      for (const auto &Layer : TheStrip.Layers)
+        Covered |= Layer.Covered.Words[WordIndex];
+
+      // LEDs that are the same in all the phases, see below
+      typename BitSetType::word_t Steady = 0;
+      while (Pending != 0) {
+        unsigned Bit = __builtin_ctz(Pending);
+        Pending &= Pending - 1;
+        size_t I = Start + Bit;
+
+        StoredColor Color = TheStrip.color(I);
+        if ((Blinking >> Bit) & 1)
+          Color = Color.scaled(FrameBlinkScale);
+        if ((Covered >> Bit) & 1) {
+          for (size_t L = 0; L < Overlays; ++L) {
+            const auto &Layer = TheStrip.Layers[L];
+            if (Layer.Covered.test(I))
+              Color = Color.interpolated(StoredColor(Layer.Colors[I]),
+                                         LayerFactors[L]);
+          }
+        }
+
+        if constexpr (Deep) {
+          // Neighboring LEDs are in different phases, so that a uniform color
+          // does not flicker as a whole. LEDs that do not dither at all are
+          // written to all the buffers right away, rather than encoded again
+          // as each phase comes.
+          bool IsSteady = false;
+          WS2812::EncodedLED LED = WS2812::encode(Dithering[0].apply(
+              Color, (FramePhase + I) % DitherPhases, IsSteady));
+          if (IsSteady) {
+            for (auto &PhaseEncoded : TheStrip.Encoded)
+              PhaseEncoded[I] = LED;
+            Steady |= typename BitSetType::word_t(1) << Bit;
+          } else {
+            Encoded[I] = LED;
+          }
+        } else {
+          Encoded[I] = WS2812::encode(Stage.apply(Color));
+        }
+      }
+
+      if constexpr (Deep)
+        for (auto &Phase : TheStrip.Stale)
+          Phase.Words[WordIndex] &= ~Steady;
+    }
+  }
+
+  static void setBlinking(StripType &TheStrip, size_t Index, bool Blink) {
+    if (Blink)
+      TheStrip.setBlinking(Index);
+    else
+      TheStrip.clearBlinking(Index);
+  }
+
+  static void encodeJob(void *Context, size_t StripIndex, size_t Chunk) {
+    auto *This = static_cast<LEDArray *>(Context);
+    This->encode(StripIndex, Chunk * ChunkWords, (Chunk + 1) * ChunkWords);
+  }
+
+  template <size_t J> void renderImpl() {
     if constexpr (J >= MaxPorts) {
       return;
     } else {
       Trace TT(event_ids::RenderStrip, J);
 
+      // Either encode the strip here or wait for the render threads to be done
+      // with it, while they might be still working on the next ones
       Trace TTT(event_ids::AdjustBlinking);
-      for (size_t I = 0; I < ActualSize; ++I) {
-        HSVColor Color = Strips[J].LEDs[I].toHSVColor();
-
-        if (Strips[J].blinks(I)) {
-          constexpr uint8_t MinValue = 0;
-          constexpr uint8_t MaxValue = 10;
-          size_t ScaledTime = Time / 1;
-          uint8_t ValueShift = ScaledTime % MaxValue;
-          if ((ScaledTime / MaxValue) & 1)
-            ValueShift = (MaxValue - 1) - ValueShift;
-          ValueShift += MinValue;
-          Color.Value = ValueShift;
-        }
-
-        Strips[J].LEDs[I] = Color.toRGBColor();
+      if (External != ExternalFormat::Encoded) {
+        if (Workers.workers() == 0)
+          encode(J, 0, BitSetType::WordCount);
+        else
+          Workers.wait(J);
       }
       TTT.stop();
 
       Trace TFlush(event_ids::FlushBuffer);
-      ArrayRef<const uint8_t> Buffer{
-          reinterpret_cast<const uint8_t *>(&Strips[J].LEDs[0]),
-          ActualSize * sizeof(RGBColor)};
+      uint64_t FlushStart = micros();
+      ArrayRef<const uint8_t> Buffer =
+          Strips[J].buffer(ActualSize, FramePhase);
+      if (External == ExternalFormat::Encoded) {
+        // Straight from the external frame to the pins
+        size_t StripBytes = ActualSize * sizeof(WS2812::EncodedLED);
+        Buffer = {ExternalData + J * StripBytes, StripBytes};
+      }
       if (J == 0) {
         WS2812Pin<0, 0>::setOutput();
         WS2812Pin<0, 0>::writeBuffer(Buffer);
@@ -151,11 +722,12 @@ public:
         WS2812Pin<3, 5>::setInput();
       }
 
+      FrameFlushMicros += micros() - FlushStart;
       TFlush.stop();
 
       TT.stop();
 
-      renderImpl<J + 1>(Time);
+      renderImpl<J + 1>();
     }
   }
 };
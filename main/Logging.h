@@ -1,6 +1,13 @@
 #pragma once
 
+#include <assert.h>
 #include <chrono>
+#include <stdio.h>
+
+#ifndef ESP_PLATFORM
+// newlib's integer-only printf is not available on the host
+#define iprintf printf
+#endif
 
 constexpr bool StaticEnableDebug = false;
 inline bool EnableDebug = true;
@@ -36,7 +43,8 @@ enum Values {
   Render,
   RenderStrip,
   AdjustBlinking,
-  FlushBuffer
+  FlushBuffer,
+  Tween
 };
 
 inline const char *getName(Values V) {
@@ -73,6 +81,8 @@ inline const char *getName(Values V) {
     return "AdjustBlinking";
   case FlushBuffer:
     return "FlushBuffer";
+  case Tween:
+    return "Tween";
   default:
     abort();
     break;
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <stdint.h>
+
+#include "Colors.h"
+
+namespace Gamma {
+
+using Table = std::array<uint8_t, 256>;
+
+/// Like Table, with the output in 1/256 of a step, so that the fraction can be
+/// dithered. For RGB16Color channels, inputs in between the entries are
+/// interpolated.
+using FineTable = std::array<uint16_t, 256>;
+
+/// Compute the Denominator-th root of X through Newton's method
+template <unsigned Denominator> constexpr double root(double X) {
+  if (X == 0)
+    return 0;
+
+  double Result = 1;
+  for (unsigned I = 0; I < 256; ++I) {
+    double Power = 1;
+    for (unsigned J = 0; J < Denominator - 1; ++J)
+      Power *= Result;
+    Result = ((Denominator - 1) * Result + X / Power) / Denominator;
+  }
+  return Result;
+}
+
+/// Build the table mapping a linear channel value to the value to send to the
+/// strip in order to obtain an apparent brightness with gamma
+/// Numerator / Denominator
+template <unsigned Numerator, unsigned Denominator>
+constexpr Table makeTable() {
+  Table Result{};
+  for (unsigned I = 0; I < Result.size(); ++I) {
+    double X = I / 255.0;
+    double Power = 1;
+    for (unsigned J = 0; J < Numerator; ++J)
+      Power *= X;
+    Result[I] = static_cast<uint8_t>(root<Denominator>(Power) * 255.0 + 0.5);
+  }
+  return Result;
+}
+
+template <unsigned Numerator, unsigned Denominator>
+constexpr FineTable makeFineTable() {
+  FineTable Result{};
+  for (unsigned I = 0; I < Result.size(); ++I) {
+    double X = I / 255.0;
+    double Power = 1;
+    for (unsigned J = 0; J < Numerator; ++J)
+      Power *= X;
+    Result[I] =
+        static_cast<uint16_t>(root<Denominator>(Power) * 255 * 256 + 0.5);
+  }
+  return Result;
+}
+
+/// The curves that can be selected at run-time, index 0 is linear
+inline constexpr std::array<Table, 5> Curves = {
+    makeTable<1, 1>(), makeTable<9, 5>(), makeTable<11, 5>(),
+    makeTable<5, 2>(), makeTable<14, 5>()};
+
+/// Curves, for 16-bit channels
+inline constexpr std::array<FineTable, 5> FineCurves = {
+    makeFineTable<1, 1>(), makeFineTable<9, 5>(), makeFineTable<11, 5>(),
+    makeFineTable<5, 2>(), makeFineTable<14, 5>()};
+
+static_assert(Curves[0][0] == 0 and Curves[0][128] == 128 and
+              Curves[0][255] == 255);
+static_assert(Curves[2][0] == 0 and Curves[2][255] == 255);
+static_assert(Curves[2][128] == 56);
+static_assert(FineCurves[0][0] == 0 and FineCurves[0][128] == 128 * 256 and
+              FineCurves[0][255] == 255 * 256);
+static_assert((FineCurves[2][128] + 128) / 256 == Curves[2][128]);
+
+} // namespace Gamma
+
+/// Temporal dithering rounds 16-bit colors to 8 bits with a different
+/// threshold in each of DitherPhases consecutive frames, see OutputStage::apply
+constexpr size_t DitherPhases = 4;
+
+/// The threshold of each phase, in 1/256 of a step, in an order that
+/// alternates as much as possible
+inline constexpr std::array<uint8_t, DitherPhases> DitherThresholds = {
+    32, 160, 96, 224};
+
+/// Fractions closer than this to a step round the same way in all the phases
+constexpr unsigned DitherMargin = 32;
+static_assert(DitherThresholds[0] == DitherMargin and
+              DitherThresholds[3] == 256 - DitherMargin);
+
+/// Final per-channel transformation applied to each LED while rendering, it
+/// combines gamma correction and global brightness in a single lookup
+class OutputStage {
+public:
+  static constexpr uint8_t MaxBrightness = 255;
+  static constexpr uint16_t NoLimit = 256;
+
+private:
+  std::array<Gamma::Table, 3> LUT;
+  uint8_t Brightness = MaxBrightness;
+  std::array<uint8_t, 3> Curves = {0, 0, 0};
+  uint16_t Limit = NoLimit;
+  uint32_t Version = 0;
+
+public:
+  OutputStage() { rebuild(); }
+
+public:
+  static bool verify(const std::array<uint8_t, 3> &Curves) {
+    for (uint8_t Curve : Curves)
+      if (Curve >= Gamma::Curves.size())
+        return false;
+    return true;
+  }
+
+  void configure(uint8_t NewBrightness,
+                 const std::array<uint8_t, 3> &NewCurves) {
+    Brightness = NewBrightness;
+    Curves = NewCurves;
+    rebuild();
+  }
+
+  /// Further scale the brightness by Factor / 256, used by the current limiter
+  /// on a per-frame basis, the tables are rebuilt only if Factor changes
+  void setLimit(uint16_t Factor) {
+    if (Factor == Limit)
+      return;
+    Limit = Factor;
+    rebuild();
+  }
+
+  uint8_t brightness() const { return Brightness; }
+
+  const std::array<uint8_t, 3> &curves() const { return Curves; }
+
+  /// Changes every time the tables are rebuilt, whatever has been produced
+  /// with an older version has to be recomputed
+  uint32_t version() const { return Version; }
+
+  /// Brightness, including the limit, as a factor out of 256
+  unsigned scale() const { return ((Brightness + 1) * Limit) >> 8; }
+
+  RGBColor apply(const RGBColor &Color) const {
+    return RGBColor(LUT[0][Color.Red], LUT[1][Color.Green], LUT[2][Color.Blue]);
+  }
+
+private:
+  void rebuild() {
+    ++Version;
+    unsigned Scale = scale();
+    for (unsigned Channel = 0; Channel < LUT.size(); ++Channel) {
+      const Gamma::Table &Curve = Gamma::Curves[Curves[Channel]];
+      for (unsigned I = 0; I < Curve.size(); ++I)
+        LUT[Channel][I] = (Curve[I] * Scale) >> 8;
+    }
+  }
+};
+
+/// The output stage for 16-bit colors, with the same settings as an
+/// OutputStage, plus temporal dithering
+class DitheringStage {
+private:
+  /// Entries of LUT for each step of an 8-bit channel
+  static constexpr unsigned FineSteps = 16;
+
+  /// Like OutputStage's, with the output in 1/256 of a step. The fine curves
+  /// are interpolated in advance, so that a lookup is all it takes.
+  std::array<std::array<uint16_t, 256 * FineSteps>, 3> LUT;
+
+  /// The settings LUT has been built for
+  unsigned Scale = ~0u;
+  std::array<uint8_t, 3> Curves = {0, 0, 0};
+
+public:
+  /// Follow the settings of Stage, to be called whenever its version changes.
+  /// The tables are rebuilt only if the brightness or the curves did change.
+  void update(const OutputStage &Stage) {
+    if (Stage.scale() == Scale and Stage.curves() == Curves)
+      return;
+
+    Scale = Stage.scale();
+    Curves = Stage.curves();
+    for (unsigned Channel = 0; Channel < LUT.size(); ++Channel) {
+      const Gamma::FineTable &Curve = Gamma::FineCurves[Curves[Channel]];
+      for (unsigned I = 0; I < Curve.size(); ++I) {
+        unsigned Low = (Curve[I] * Scale) >> 8;
+        unsigned High = (Curve[std::min<unsigned>(I + 1, 255)] * Scale) >> 8;
+        unsigned Sum = Low * FineSteps;
+        for (unsigned J = 0; J < FineSteps; ++J, Sum += High - Low)
+          LUT[Channel][I * FineSteps + J] = Sum / FineSteps;
+      }
+    }
+  }
+
+  /// Transform a 16-bit color for dither phase Phase: the fraction of each
+  /// channel that does not fit in 8 bits adds a step in the phases whose
+  /// threshold it reaches, so that the average over DitherPhases frames
+  /// matches the 16-bit output to a quarter of a step. Since the result only
+  /// depends on the phase, each phase can be encoded once and shown in turn.
+  /// Steady is set if the result is the same in all the phases.
+  RGBColor apply(const RGB16Color &Color, size_t Phase, bool &Steady) const {
+    unsigned Threshold = DitherThresholds[Phase];
+    unsigned Dithered = 0;
+    auto Channel = [this, Threshold, &Dithered](unsigned Index,
+                                                uint16_t Value) {
+      unsigned Fine = LUT[Index][Value / (256 / FineSteps)];
+      Dithered |= uint8_t(Fine + DitherMargin) >= 2 * DitherMargin;
+      return uint8_t((Fine + Threshold) >> 8);
+    };
+    RGBColor Result(Channel(0, Color.Red), Channel(1, Color.Green),
+                    Channel(2, Color.Blue));
+    Steady = Dithered == 0;
+    return Result;
+  }
+};
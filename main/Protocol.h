@@ -0,0 +1,156 @@
+#pragma once
+
+#include <array>
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "Output.h"
+
+/// Definitions of the wire protocol, shared between the firmware and the host
+/// tools.
+///
+/// Each command is made of an identifier_t, a length_t with the size of the
+/// payload and the payload itself. All the fields are little endian. Commands
+/// are sent in frames, see Framing.h.
+namespace Command {
+
+using identifier_t = uint8_t;
+using length_t = uint32_t;
+
+namespace ids {
+enum Values : identifier_t {
+  Helo = 1,
+  UpdateRange = 2,
+  MoveCursor = 3,
+  Configure = 4,
+  SetOutput = 5,
+  SetPowerBudget = 6,
+  GetStats = 7,
+  Probe = 8,
+  UpdateTarget = 9,
+  Tween = 10,
+  UploadAnimation = 11,
+  PlayAnimation = 12,
+  SetBootFrame = 13,
+  SelectLayer = 14,
+  ConfigureLayer = 15,
+  SetTile = 16,
+  Present = 17
+};
+} // namespace ids
+
+struct cursor_t {
+  uint32_t Column;
+  uint32_t Line;
+
+  void operator++() { ++Column; }
+
+  cursor_t operator+(size_t Columns) const {
+    cursor_t Result = *this;
+    Result.Column += Columns;
+    return Result;
+  }
+
+  bool verify() const {
+    // TODO: fix
+    return Column < 80 and Line < 22;
+  }
+};
+
+struct ConfigureMessage {
+  uint8_t Debug = 0;
+
+  bool verify() const { return Debug < 2; }
+};
+
+struct OutputMessage {
+  uint8_t Brightness = OutputStage::MaxBrightness;
+  std::array<uint8_t, 3> Gamma = {0, 0, 0};
+
+  bool verify() const { return OutputStage::verify(Gamma); }
+};
+
+struct PowerBudgetMessage {
+  uint32_t Milliamps = 0;
+};
+
+struct GetStatsMessage {
+  uint8_t Reset = 0;
+
+  bool verify() const { return Reset < 2; }
+};
+
+/// Start a transition to the colors staged with UpdateTarget
+struct TweenMessage {
+  /// Duration in frames, the targets are reached in the last one
+  uint32_t Frames = 0;
+};
+
+struct PlayAnimationMessage {
+  enum Modes : uint8_t { Stop, Once, Loop };
+  uint8_t Mode = Stop;
+
+  bool verify() const { return Mode <= Loop; }
+};
+
+/// Which frame to show at boot, see Snapshot::Modes
+struct BootFrameMessage {
+  uint8_t Mode = 0;
+
+  bool verify() const { return Mode < 3; }
+};
+
+/// Choose the layer UpdateRange writes to, 0 being the LEDs themselves
+struct SelectLayerMessage {
+  uint8_t Layer = 0;
+};
+
+/// Settings of an overlay, see LayerSettings
+struct ConfigureLayerMessage {
+  enum Flag : uint8_t {
+    /// LEDs written with Key are transparent
+    Keyed = 1,
+    /// Make the whole layer transparent
+    Clear = 2
+  };
+
+  uint8_t Layer = 1;
+  uint8_t Opacity = 255;
+  uint8_t Flags = Keyed;
+  RGBColor Key;
+
+  bool verify() const { return (Flags & ~(Keyed | Clear)) == 0; }
+};
+
+/// Make the controller one tile of a larger canvas. Cursors are then in canvas
+/// coordinates and LEDs outside of the tile are ignored, so that the same
+/// stream can be sent to all the tiles.
+struct TileMessage {
+  /// Position of the first LED of the tile in the canvas
+  cursor_t Origin = {0, 0};
+  /// Show frames only when a Present is received
+  uint8_t Synchronized = 0;
+  std::array<uint8_t, 3> Reserved = {0, 0, 0};
+
+  bool verify() const { return Synchronized < 2; }
+};
+
+struct ProbeMessage {
+  uint32_t Sequence = 0;
+};
+
+/// Timestamps of a Probe command, sent back once it has been flushed
+struct ProbeReply {
+  uint32_t Sequence = 0;
+  /// Number of the first frame rendered after the probe
+  uint32_t Frame = 0;
+  uint64_t HeaderMicros = 0;
+  uint64_t ParsedMicros = 0;
+  uint64_t RenderedMicros = 0;
+  uint64_t FlushedMicros = 0;
+};
+
+static_assert(sizeof(ProbeReply) == 40);
+
+} // namespace Command
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <array>
+#include <assert.h>
+#include <atomic>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#else
+#include <thread>
+#include <vector>
+#endif
+
+/// Distributes the jobs of a frame among a set of worker threads and the
+/// thread calling wait.
+///
+/// Jobs are organized in groups (e.g., one per strip) and are claimed through
+/// a single atomic counter, in group order, so that idle workers automatically
+/// pick up work the others did not get to yet. Each group has its own atomic
+/// count of outstanding jobs: the consumer of a group (e.g., the flush stage)
+/// waits on it alone and can proceed while other groups are still being
+/// processed. No locks are involved.
+template <size_t Groups, size_t JobsPerGroup> class Scheduler {
+public:
+  using job_function_t = void (*)(void *Context, size_t Group, size_t Job);
+  static constexpr size_t Jobs = Groups * JobsPerGroup;
+  static constexpr size_t MaxWorkers = 4;
+
+private:
+  job_function_t Function;
+  void *Context;
+
+  std::atomic<size_t> NextJob{Jobs};
+  std::array<std::atomic<size_t>, Groups> Remaining{};
+
+  /// Bumped to wake up the workers at the beginning of each frame
+  std::atomic<uint32_t> Generation{0};
+  size_t Workers = 0;
+
+#ifdef ESP_PLATFORM
+  std::array<TaskHandle_t, MaxWorkers> Handles{};
+#else
+  std::atomic<bool> Stopping{false};
+  std::vector<std::thread> Threads;
+#endif
+
+public:
+  Scheduler(job_function_t Function, void *Context)
+      : Function(Function), Context(Context) {}
+
+  Scheduler(const Scheduler &) = delete;
+  Scheduler &operator=(const Scheduler &) = delete;
+
+  ~Scheduler() {
+#ifndef ESP_PLATFORM
+    Stopping = true;
+    ++Generation;
+    Generation.notify_all();
+    for (std::thread &Thread : Threads)
+      Thread.join();
+#endif
+  }
+
+public:
+  /// Number of worker threads, in addition to the one calling begin/wait. With
+  /// no workers the caller is expected to run the jobs inline.
+  size_t workers() const { return Workers; }
+
+  /// Spawn Count worker threads, can be called only once
+  void startWorkers(size_t Count) {
+    assert(Workers == 0 and Count <= MaxWorkers);
+    Workers = Count;
+    for (size_t I = 0; I < Count; ++I) {
+#ifdef ESP_PLATFORM
+      BaseType_t Core = (I + 1) % portNUM_PROCESSORS;
+      BaseType_t Result =
+          xTaskCreatePinnedToCore(&Scheduler::workerEntry, "render", 4096,
+                                  this, configMAX_PRIORITIES - 1, &Handles[I],
+                                  Core);
+      assert(Result == pdPASS);
+#else
+      Threads.emplace_back(&Scheduler::workerLoop, this);
+#endif
+    }
+  }
+
+  /// Make all the jobs available, whatever the jobs read must have been
+  /// written before calling this
+  void begin() {
+    for (std::atomic<size_t> &Count : Remaining)
+      Count.store(JobsPerGroup, std::memory_order_relaxed);
+    NextJob.store(0, std::memory_order_release);
+
+#ifdef ESP_PLATFORM
+    for (size_t I = 0; I < Workers; ++I)
+      xTaskNotifyGive(Handles[I]);
+#else
+    Generation.fetch_add(1, std::memory_order_release);
+    Generation.notify_all();
+#endif
+  }
+
+  /// Wait until all the jobs of Group are done, helping out in the meantime
+  void wait(size_t Group) {
+    while (Remaining[Group].load(std::memory_order_acquire) != 0)
+      runOne();
+  }
+
+private:
+  bool runOne() {
+    // Check before claiming, so that the counter cannot run away while
+    // waiting
+    if (NextJob.load(std::memory_order_relaxed) >= Jobs)
+      return false;
+
+    size_t Job = NextJob.fetch_add(1, std::memory_order_acq_rel);
+    if (Job >= Jobs)
+      return false;
+
+    size_t Group = Job / JobsPerGroup;
+    Function(Context, Group, Job % JobsPerGroup);
+    Remaining[Group].fetch_sub(1, std::memory_order_release);
+    return true;
+  }
+
+#ifdef ESP_PLATFORM
+  static void workerEntry(void *Argument) {
+    auto *This = static_cast<Scheduler *>(Argument);
+    while (true) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      while (This->runOne()) {
+      }
+    }
+  }
+#else
+  void workerLoop() {
+    uint32_t Seen = 0;
+    while (true) {
+      Generation.wait(Seen, std::memory_order_acquire);
+      Seen = Generation.load(std::memory_order_acquire);
+      if (Stopping)
+        return;
+      while (runOne()) {
+      }
+    }
+  }
+#endif
+};
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "sdkconfig.h"
+#endif
+
+#include "LED.h"
+#include "Stats.h"
+
+/// The frame shown at boot, before anything has been received.
+///
+/// While running, the LEDs are saved to NVS once they have been stable for a
+/// while, by a background task so that rendering goes on in the meantime. At
+/// boot the saved frame, along with the output stage and power settings, is
+/// restored and rendered before anything else.
+namespace Snapshot {
+
+#ifdef CONFIG_LEDIAN_SNAPSHOT_DELAY_MS
+constexpr uint64_t StableMicros =
+    uint64_t(CONFIG_LEDIAN_SNAPSHOT_DELAY_MS) * 1000;
+#else
+constexpr uint64_t StableMicros = 5000000;
+#endif
+
+enum class Modes : uint8_t {
+  /// Save the last frame that has been stable for StableMicros
+  Automatic,
+  /// Keep showing the frame that has been explicitly saved
+  Pinned,
+  /// Start with the LEDs off
+  Disabled
+};
+
+/// What has been found at boot, see Keeper::restore
+enum class Boot : uint8_t {
+  /// No valid snapshot, e.g., the first time
+  Missing,
+  /// The saved frame is back on the LEDs
+  Restored,
+  /// The LEDs are to stay off, see Modes::Disabled
+  Dark
+};
+
+#ifndef ESP_PLATFORM
+/// On the host, the snapshot is saved to this file, if set
+inline const char *HostFile = nullptr;
+#endif
+
+template <size_t MaxSize, size_t MaxPorts> struct Image {
+  static constexpr uint32_t ExpectedMagic = 0x504e534c; // "LSNP"
+  static constexpr uint32_t CurrentVersion = 1;
+
+  uint32_t Magic = ExpectedMagic;
+  uint32_t Version = CurrentVersion;
+  Modes Mode = Modes::Automatic;
+  uint8_t Brightness = OutputStage::MaxBrightness;
+  std::array<uint8_t, 3> Curves = {0, 0, 0};
+  uint32_t MilliampBudget = 0;
+  std::array<std::array<RGBColor, MaxSize>, MaxPorts> LEDs;
+  std::array<BitSet<MaxSize>, MaxPorts> Blink;
+
+  bool verify() const {
+    return Magic == ExpectedMagic and Version == CurrentVersion and
+           Mode <= Modes::Disabled and OutputStage::verify(Curves);
+  }
+};
+
+template <size_t MaxSize, size_t MaxPorts> class Keeper {
+public:
+  using ArrayType = LEDArray<MaxSize, MaxPorts>;
+  using ImageType = Image<MaxSize, MaxPorts>;
+
+private:
+  /// What is being saved, owned by the background task while Writing
+  ImageType Buffer;
+  std::atomic<bool> Writing{false};
+  /// Whether Buffer has been written successfully, also owned by the
+  /// background task while Writing
+  bool Stored = false;
+  /// Whether Stored is yet to be accounted in Statistics, which only the main
+  /// task touches
+  bool Uncounted = false;
+
+  Modes Mode = Modes::Automatic;
+  uint32_t SeenRevision = 0;
+  uint32_t SavedRevision = 0;
+  uint64_t LastChangeMicros = 0;
+
+#ifdef ESP_PLATFORM
+  TaskHandle_t Writer = nullptr;
+#endif
+
+public:
+  /// Prepare the storage and start the background task
+  void begin() {
+#ifdef ESP_PLATFORM
+    esp_err_t Result = nvs_flash_init();
+    if (Result == ESP_ERR_NVS_NO_FREE_PAGES or
+        Result == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+      nvs_flash_erase();
+      nvs_flash_init();
+    }
+
+    xTaskCreate(&Keeper::writerEntry, "snapshot", 3072, this,
+                tskIDLE_PRIORITY + 1, &Writer);
+#endif
+  }
+
+  /// Bring back the saved frame, if there is one and it is not disabled
+  Boot restore(ArrayType &LEDs) {
+    if (not load() or not Buffer.verify())
+      return Boot::Missing;
+
+    Mode = Buffer.Mode;
+    if (Mode == Modes::Disabled)
+      return Boot::Dark;
+
+    for (size_t J = 0; J < MaxPorts; ++J) {
+      auto &Strip = LEDs.Strips[J];
+      for (size_t I = 0; I < LEDs.size(); ++I) {
+        Strip.set(I, Buffer.LEDs[J][I]);
+        if (Buffer.Blink[J].test(I))
+          Strip.setBlinking(I);
+      }
+    }
+    LEDs.Stage.configure(Buffer.Brightness, Buffer.Curves);
+    LEDs.MilliampBudget = Buffer.MilliampBudget;
+
+    // No need to save it again
+    SeenRevision = SavedRevision = revision(LEDs);
+    return Boot::Restored;
+  }
+
+  /// To be called after each frame, saves the LEDs once they have been stable
+  /// for StableMicros
+  void update(const ArrayType &LEDs, uint64_t NowMicros) {
+    count();
+
+    uint32_t Revision = revision(LEDs);
+    if (Revision != SeenRevision) {
+      SeenRevision = Revision;
+      LastChangeMicros = NowMicros;
+      return;
+    }
+
+    if (Mode != Modes::Automatic or Revision == SavedRevision or
+        NowMicros - LastChangeMicros < StableMicros)
+      return;
+
+    // Try again later if the previous snapshot is still being written
+    if (Writing.load(std::memory_order_acquire))
+      return;
+
+    save(LEDs);
+    SavedRevision = Revision;
+  }
+
+  /// With Pinned, save the LEDs right away and stop saving them
+  /// automatically, with Disabled forget the saved frame
+  void setMode(Modes NewMode, const ArrayType &LEDs) {
+    Mode = NewMode;
+    waitForWriter();
+    save(LEDs);
+    SavedRevision = revision(LEDs);
+  }
+
+private:
+  static uint32_t revision(const ArrayType &LEDs) {
+    uint32_t Result = 0;
+    for (const auto &Strip : LEDs.Strips)
+      Result += Strip.Revision;
+    return Result;
+  }
+
+  void waitForWriter() {
+    while (Writing.load(std::memory_order_acquire)) {
+#ifdef ESP_PLATFORM
+      vTaskDelay(1);
+#endif
+    }
+    count();
+  }
+
+  /// Account the last snapshot once the background task is done with it
+  void count() {
+    if (not Uncounted or Writing.load(std::memory_order_acquire))
+      return;
+    if (Stored)
+      ++Statistics.Snapshots;
+    Uncounted = false;
+  }
+
+  /// Copy the LEDs into Buffer and have it written
+  void save(const ArrayType &LEDs) {
+    // Field by field, an ImageType temporary would not fit on the stack
+    Buffer.Magic = ImageType::ExpectedMagic;
+    Buffer.Version = ImageType::CurrentVersion;
+    Buffer.Mode = Mode;
+    Buffer.Brightness = LEDs.Stage.brightness();
+    Buffer.Curves = LEDs.Stage.curves();
+    Buffer.MilliampBudget = LEDs.MilliampBudget;
+    for (size_t J = 0; J < MaxPorts; ++J) {
+      Buffer.LEDs[J] = LEDs.Strips[J].LEDs;
+      Buffer.Blink[J] = LEDs.Strips[J].Blink;
+    }
+
+    Uncounted = true;
+    Writing.store(true, std::memory_order_release);
+#ifdef ESP_PLATFORM
+    xTaskNotifyGive(Writer);
+#else
+    Stored = store();
+    Writing.store(false, std::memory_order_release);
+    count();
+#endif
+  }
+
+#ifdef ESP_PLATFORM
+  static void writerEntry(void *Argument) {
+    auto *This = static_cast<Keeper *>(Argument);
+    while (true) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      This->Stored = This->store();
+      This->Writing.store(false, std::memory_order_release);
+    }
+  }
+
+  bool load() {
+    nvs_handle_t Handle;
+    if (nvs_open("ledian", NVS_READONLY, &Handle) != ESP_OK)
+      return false;
+    size_t Size = sizeof(Buffer);
+    esp_err_t Result = nvs_get_blob(Handle, "boot", &Buffer, &Size);
+    nvs_close(Handle);
+    return Result == ESP_OK and Size == sizeof(Buffer);
+  }
+
+  bool store() {
+    nvs_handle_t Handle;
+    if (nvs_open("ledian", NVS_READWRITE, &Handle) != ESP_OK)
+      return false;
+    bool Result =
+        nvs_set_blob(Handle, "boot", &Buffer, sizeof(Buffer)) == ESP_OK and
+        nvs_commit(Handle) == ESP_OK;
+    nvs_close(Handle);
+    return Result;
+  }
+#else
+  bool load() {
+    FILE *File = HostFile != nullptr ? fopen(HostFile, "rb") : nullptr;
+    if (File == nullptr)
+      return false;
+    bool Result = fread(&Buffer, sizeof(Buffer), 1, File) == 1;
+    fclose(File);
+    return Result;
+  }
+
+  bool store() {
+    FILE *File = HostFile != nullptr ? fopen(HostFile, "wb") : nullptr;
+    if (File == nullptr)
+      return false;
+    bool Result = fwrite(&Buffer, sizeof(Buffer), 1, File) == 1;
+    fclose(File);
+    return Result;
+  }
+#endif
+};
+
+} // namespace Snapshot
+
+inline Snapshot::Keeper<MaxLEDs, MaxPorts> BootFrame;
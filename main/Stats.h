@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <stdint.h>
+
+#include "Logging.h"
+
+inline uint64_t micros() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(ledian_clock::now() - start_time).count();
+}
+
+/// Distribution of the duration of an activity
+struct TimeStats {
+  uint64_t TotalMicros = 0;
+  uint32_t Count = 0;
+  uint32_t MinMicros = UINT32_MAX;
+  uint32_t MaxMicros = 0;
+  uint32_t LastMicros = 0;
+
+  void add(uint32_t Micros) {
+    TotalMicros += Micros;
+    ++Count;
+    MinMicros = Micros < MinMicros ? Micros : MinMicros;
+    MaxMicros = Micros > MaxMicros ? Micros : MaxMicros;
+    LastMicros = Micros;
+  }
+};
+
+static_assert(sizeof(TimeStats) == 24);
+
+/// Always-on counters describing how the device is doing. They are cheap
+/// enough to be updated unconditionally and the GetStats command returns them
+/// verbatim, hence the fixed-width fields and the explicit layout.
+struct Stats {
+  static constexpr size_t MaxCommands = 24;
+
+  /// The main loop renders a frame every FramePeriodMicros, frames taking
+  /// longer count as overruns
+  static constexpr uint32_t FramePeriodMicros = 10000;
+
+  uint64_t UptimeMicros = 0;
+  /// Bytes of command payload received, headers excluded
+  uint64_t PayloadBytes = 0;
+  uint32_t Frames = 0;
+  /// Frames whose rendering took longer than FramePeriodMicros
+  uint32_t Overruns = 0;
+  /// Commands rejected, e.g., with an unknown identifier or invalid payload
+  uint32_t ParseErrors = 0;
+  uint32_t EstimatedMilliamps = 0;
+  uint32_t LimitedFrames = 0;
+  uint32_t PowerLimit = 0;
+  /// Commands received, by identifier
+  std::array<uint32_t, MaxCommands> Commands{};
+  TimeStats Parse;
+  TimeStats Render;
+  TimeStats Flush;
+  /// Frames received intact
+  uint32_t ReceivedFrames = 0;
+  /// Frames dropped since they were not valid COBS or too short
+  uint32_t FramingErrors = 0;
+  /// Frames dropped due to a CRC mismatch
+  uint32_t CRCErrors = 0;
+  /// Frames dropped since they did not fit in the receive buffer
+  uint32_t Overflows = 0;
+  /// From boot to the end of the first frame, not affected by resets
+  uint32_t FirstFrameMicros = 0;
+  /// Frames saved to be shown at boot
+  uint32_t Snapshots = 0;
+};
+
+static_assert(sizeof(Stats) == 232);
+
+inline Stats Statistics;
+
+/// Record the duration of the enclosing scope into a TimeStats
+class Measure {
+private:
+  TimeStats *Target;
+  uint64_t Start;
+
+public:
+  Measure(TimeStats &Target) : Target(&Target), Start(micros()) {}
+
+  ~Measure() { stop(); }
+
+  void stop() {
+    if (Target != nullptr) {
+      Target->add(micros() - Start);
+      Target = nullptr;
+    }
+  }
+};
@@ -1,9 +1,14 @@
+#include <fcntl.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <unistd.h>
 
+#include "driver/uart.h"
+#include "driver/uart_vfs.h"
 #include "esp_chip_info.h"
 #include "esp_flash.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "sdkconfig.h"
@@ -11,8 +16,18 @@
 #include "Logging.h"
 #include "LED.h"
 #include "Command.h"
+#include "Snapshot.h"
 
 extern "C" void app_main(void) {
+  start_time = ledian_clock::now();
+
+  // Get the last frame back on the strips before anything else
+  LEDs.resize(MaxLEDs);
+  BootFrame.begin();
+  Snapshot::Boot Found = BootFrame.restore(LEDs);
+  LEDs.render(0);
+  Statistics.FirstFrameMicros = esp_timer_get_time();
+
   printf("Hello world!\n");
 
   /* Print chip information */
@@ -42,12 +57,18 @@ extern "C" void app_main(void) {
 
   printf("Minimum free heap size: %" PRIu32 " bytes\n",
          esp_get_minimum_free_heap_size());
+  printf("First frame after %" PRIu32 " us%s\n", Statistics.FirstFrameMicros,
+         Found == Snapshot::Boot::Restored ? ", restored"
+         : Found == Snapshot::Boot::Dark   ? ", dark"
+                                           : "");
 
+#if CONFIG_LEDIAN_STARTUP_COUNTDOWN
   for (int i = 10; i >= 0; i--) {
     printf("Restarting in %d seconds...\n", i);
     vTaskDelay(1000 / portTICK_PERIOD_MS);
   }
   printf("Restarting now.\n");
+#endif
   fflush(stdout);
 
   Trace M(event_ids::Main);
@@ -57,9 +78,12 @@ extern "C" void app_main(void) {
     // TODO
   }
 
-  LEDs.resize(MaxLEDs);
+  // Spread the encoding of the strips over all the available cores
+  LEDs.setRenderThreads(portNUM_PROCESSORS);
 
-  {
+  // Test pattern, unless there was a frame to restore or the LEDs have to stay
+  // off
+  if (Found == Snapshot::Boot::Missing) {
     Trace T(event_ids::InitialSetup);
     for (size_t J = 0; J < MaxPorts; ++J) {
       size_t Index = 0;
@@ -67,25 +91,55 @@ extern "C" void app_main(void) {
         if (Index >= MaxLEDs)
           break;
         LEDs.Strips[J].setBlinking(Index);
-        LEDs.Strips[J].LEDs[Index++] = RGBColor(10, 0, 0);
+        LEDs.Strips[J].write(Index++, RGBColor(10, 0, 0));
         if (Index >= MaxLEDs)
           break;
-        LEDs.Strips[J].LEDs[Index++] = RGBColor(0, 10, 0);
+        LEDs.Strips[J].write(Index++, RGBColor(0, 10, 0));
         if (Index >= MaxLEDs)
           break;
-        LEDs.Strips[J].LEDs[Index++] = RGBColor(0, 0, 10);
+        LEDs.Strips[J].write(Index++, RGBColor(0, 0, 10));
       }
     }
   }
 
+  // Let the console sleep waiting for input, through the interrupt-driven
+  // driver, and parse without blocking
+  constexpr int ReceiveBufferSize = 2 * Framing::MaxEncodedSize;
+  uart_driver_install(CONFIG_ESP_CONSOLE_UART_NUM, ReceiveBufferSize, 0, 0,
+                      nullptr, 0);
+  uart_vfs_dev_use_driver(CONFIG_ESP_CONSOLE_UART_NUM);
+  fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+
+  // Render at a fixed rate, also while no command is coming in, so that
+  // transitions and blinking keep their pace, and leave the rest of the time
+  // to parsing or to the other tasks
   size_t Time = 0;
+  uint64_t NextFrame = micros();
 
   while (true) {
     Trace T(event_ids::MainLoopIteration, Time);
-    Command::parse();
-    LEDs.render(Time);
-    // miosix::Thread::sleep(10);
-    ++Time;
+
+    // Parse what comes in until the next frame is due, at least once even if
+    // it is late
+    uint64_t Now = micros();
+    do {
+      Command::waitForInput(NextFrame > Now ? NextFrame - Now : 0);
+      Command::parse();
+      Now = micros();
+    } while (Now < NextFrame);
+
+    // After an overrun, start over from now rather than making up for the
+    // frames that have been missed
+    NextFrame += Stats::FramePeriodMicros;
+    if (NextFrame <= Now)
+      NextFrame = Now + Stats::FramePeriodMicros;
+
+    if (Command::frameReady()) {
+      LEDs.render(Time);
+      Command::frameDone();
+      ++Time;
+    }
+    BootFrame.update(LEDs, micros());
   }
 
   esp_restart();